@@ -1,302 +1,992 @@
-#include <ctype.h>
+#define _GNU_SOURCE
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
-#define MAX_PREFIXES 1024
-#define PREFIX_LEN 3
+#include "checkpoint.h"
+#include "perf.h"
+#include "rankset.h"
+#include "stats.h"
+#include "wordgraph.h"
+#include "writer.h"
 
-struct IntVec {
-  int len;
-  int cap;
-  int *data;
+#define MAX_PASSWORD_LEN 1024 /* in prefixes, for --from-passwords */
+
+void print_phrase(FILE *out, struct WordGraph *g, const int *prefixes_chosen,
+                  const int *words, int length, int start_word) {
+  int i;
+  for (i = 0; i < length; i++)
+    fprintf(out, "%.3s", g->prefixes[prefixes_chosen[i]].prefix);
+  fprintf(out, "   ");
+  if (start_word)
+    fprintf(out, " %s", g->words[start_word]);
+  for (i = 0; i < length; i++)
+    fprintf(out, " %s", g->words[words[i]]);
+  fprintf(out, "\n");
+}
+
+/* passwords are solved in batches, spread over a number of threads, and
+   printed in order once the whole batch is done */
+#define BATCH_SIZE 4096
+
+/* password i of a batch is made of the prefixes in
+   [start->data[i], start->data[i + 1]) */
+struct PhraseBatch {
+  struct WordGraph *g;
+  int start_word;
+  struct IntVec *start;
+  struct IntVec *prefixes;
+  int *words;
+  int words_cap;
+  int next; /* next password to be claimed by a worker */
 };
 
-struct IntVec *intvec_alloc() {
-  struct IntVec *vec = malloc(sizeof *vec);
-  vec->len = 0;
-  vec->cap = 1;
-  vec->data = malloc(sizeof(int) * vec->cap);
-  return vec;
+struct PhraseBatch *phrase_batch_alloc(struct WordGraph *g, int start_word) {
+  struct PhraseBatch *b = malloc(sizeof *b);
+  b->g = g;
+  b->start_word = start_word;
+  b->start = intvec_alloc();
+  b->prefixes = intvec_alloc();
+  b->words = NULL;
+  b->words_cap = 0;
+  intvec_append(b->start, 0);
+  return b;
 }
 
-void intvec_free(struct IntVec *vec) {
-  free(vec->data);
-  free(vec);
+void phrase_batch_free(struct PhraseBatch *b) {
+  intvec_free(b->start);
+  intvec_free(b->prefixes);
+  free(b->words);
+  free(b);
 }
 
-void intvec_append(struct IntVec *vec, int val) {
-  if (vec->len == vec->cap) {
-    vec->cap *= 2;
-    vec->data = realloc(vec->data, sizeof(int) * vec->cap);
-  }
-  vec->data[vec->len++] = val;
+void phrase_batch_clear(struct PhraseBatch *b) {
+  b->start->len = 1;
+  b->prefixes->len = 0;
 }
 
-int intvec_get(struct IntVec *vec, int pos) {
-  if (pos < 0 || pos >= vec->len)
-    err(10, "invalid vector index %d not in [0, %d)", pos, vec->len);
-  return vec->data[pos];
+int phrase_batch_len(struct PhraseBatch *b) { return b->start->len - 1; }
+
+/* add a password to the batch. An empty password is a placeholder. */
+void phrase_batch_add(struct PhraseBatch *b, const int *prefixes_chosen,
+                      int length) {
+  int i;
+  for (i = 0; i < length; i++)
+    intvec_append(b->prefixes, prefixes_chosen[i]);
+  intvec_append(b->start, b->prefixes->len);
 }
 
-struct IntVec *intvec_copy(struct IntVec *vec) {
-  /* could be faster, but no need to optimize */
-  struct IntVec *ret = intvec_alloc();
+static void *phrase_batch_worker(void *arg) {
+  struct PhraseBatch *b = arg;
+  int n = phrase_batch_len(b);
   int i;
-  for (i = 0; i < vec->len; i++)
-    intvec_append(ret, vec->data[i]);
-  return ret;
+  while ((i = __sync_fetch_and_add(&b->next, 1)) < n) {
+    int begin = b->start->data[i], end = b->start->data[i + 1];
+    if (end > begin)
+      wordgraph_phrase(b->g, b->prefixes->data + begin, end - begin,
+                       b->start_word, b->words + begin);
+  }
+  stats_flush();
+  return NULL;
 }
 
-void intvec_print(struct IntVec *vec) {
+void phrase_batch_solve(struct PhraseBatch *b, int n_threads) {
   int i;
-  printf("[");
-  for (i = 0; i < vec->len; i++) {
-    if (i != 0)
-      printf(", ");
-    printf("%d", vec->data[i]);
-  }
-  printf("]");
-}
-
-/* return a new IntVec with the elements in common between a and b.
-   Requires a and b to be sorted. */
-struct IntVec *intvec_intersect(struct IntVec *a, struct IntVec *b) {
-  struct IntVec *ret = intvec_alloc();
-  int ai = 0, bi = 0;
-  while (ai < a->len && bi < b->len) {
-    int diff = a->data[ai] - b->data[bi];
-    if (diff == 0) {
-      intvec_append(ret, a->data[ai]);
-      ai++, bi++;
-    } else if (diff < 0) {
-      ai++;
-    } else if (diff > 0) {
-      bi++;
-    }
+  if (b->words_cap < b->prefixes->len) {
+    b->words_cap = b->prefixes->len;
+    b->words = realloc(b->words, sizeof(int) * b->words_cap);
   }
-  return ret;
+  b->next = 0;
+  if (n_threads > phrase_batch_len(b))
+    n_threads = phrase_batch_len(b);
+  pthread_t threads[n_threads > 1 ? n_threads - 1 : 1];
+  for (i = 0; i < n_threads - 1; i++)
+    if (pthread_create(&threads[i], NULL, phrase_batch_worker, b))
+      errx(7, "unable to start worker thread");
+  phrase_batch_worker(b);
+  for (i = 0; i < n_threads - 1; i++)
+    pthread_join(threads[i], NULL);
 }
 
-struct WordGraph {
-  int n_words;
-  int n_prefixes;
-  char **words;
-  char **followers_compressed;
-  struct {
-    char prefix[PREFIX_LEN];
-    struct IntVec *words;
-  } prefixes[MAX_PREFIXES];
-};
+/* print password i of a solved batch, returning its length */
+int phrase_batch_print(FILE *out, struct PhraseBatch *b, int i) {
+  int begin = b->start->data[i], end = b->start->data[i + 1];
+  if (end > begin) {
+    PERF_BEGIN(PERF_FORMAT);
+    print_phrase(out, b->g, b->prefixes->data + begin, b->words + begin,
+                 end - begin, b->start_word);
+    PERF_END(PERF_FORMAT);
+  }
+  return end - begin;
+}
 
-void getline_trimmed(char **target, FILE *stream) {
-  size_t n, len;
-  n = 0;
-  *target = NULL;
-  if (getline(target, &n, stream) == -1)
-    err(1, "corrupted wordgraph file");
-  len = strlen(*target);
-  if ((*target)[len - 1] == '\n')
-    (*target)[len - 1] = 0;
-}
-
-struct WordGraph *wordgraph_init(const char *filename) {
-  int i, j;
-  FILE *graph_file = fopen(filename, "r");
-  if (!graph_file)
+/* open a file for reading, with - meaning stdin */
+FILE *open_input(const char *filename) {
+  FILE *in = strcmp(filename, "-") ? fopen(filename, "r") : stdin;
+  if (!in)
     err(1, "unable to open %s", filename);
-  struct WordGraph *g = malloc(sizeof *g);
-  if (fscanf(graph_file, "%d ", &g->n_words) != 1)
-    err(1, "corrupted wordgraph file");
-  g->n_prefixes = 0;
-  g->words = calloc(g->n_words, sizeof g->words[0]);
-  g->followers_compressed = calloc(g->n_words, sizeof g->words[0]);
-  for (i = 1; i < g->n_words; i++) {
-    getline_trimmed(&g->words[i], graph_file);
-    /* extract lowercase prefix */
-    char prefix[PREFIX_LEN];
-    for (j = 0; j < PREFIX_LEN; j++)
-        prefix[j] = tolower(g->words[i][j]);
-    /* add word to a prefix group */
-    for (j = 0; j <= g->n_prefixes; ++j) {
-      if (j == g->n_prefixes) {
-        /* none found, need to insert */
-        if (g->n_prefixes == MAX_PREFIXES)
-          errx(2, "corrupted wordgraph file: too many prefixes");
-        g->n_prefixes++;
-        memcpy(g->prefixes[j].prefix, prefix, PREFIX_LEN);
-        g->prefixes[j].words = intvec_alloc();
-      }
-      if (!memcmp(g->prefixes[j].prefix, prefix, PREFIX_LEN)) {
-        intvec_append(g->prefixes[j].words, i);
+  return in;
+}
+
+void close_input(FILE *in) {
+  if (in != stdin)
+    fclose(in);
+}
+
+/* regenerate the mnemonics for a file of passwords, one per line */
+void regenerate_passwords(struct WordGraph *g, const char *filename,
+                          int start_word, int n_threads) {
+  FILE *in = open_input(filename);
+
+  struct PhraseBatch *b = phrase_batch_alloc(g, start_word);
+  char *lines[BATCH_SIZE] = {NULL};
+  size_t line_caps[BATCH_SIZE] = {0};
+  int prefixes_chosen[MAX_PASSWORD_LEN];
+  long line_no = 0;
+  int i, n = 0, done = 0;
+
+  while (!done) {
+    phrase_batch_clear(b);
+    for (n = 0; n < BATCH_SIZE; n++) {
+      ssize_t len = getline(&lines[n], &line_caps[n], in);
+      if (len == -1) {
+        done = 1;
         break;
       }
+      line_no++;
+      while (len && (lines[n][len - 1] == '\n' || lines[n][len - 1] == '\r'))
+        lines[n][--len] = 0;
+      int length = wordgraph_split_password(g, lines[n], prefixes_chosen,
+                                            MAX_PASSWORD_LEN);
+      if (length < 0) {
+        warnx("line %ld: not an abbrase password: %s", line_no, lines[n]);
+        length = 0;
+      }
+      phrase_batch_add(b, prefixes_chosen, length);
     }
+    phrase_batch_solve(b, n_threads);
+    for (i = 0; i < n; i++)
+      if (!phrase_batch_print(stdout, b, i))
+        printf("%s\n", lines[i]);
   }
-  if (g->n_prefixes != MAX_PREFIXES)
-    errx(3, "corrupted wordgraph file: not enough prefixes");
-  for (i = 0; i < g->n_words; i++)
-    getline_trimmed(&g->followers_compressed[i], graph_file);
-  return g;
+
+  for (i = 0; i < BATCH_SIZE; i++)
+    free(lines[i]);
+  phrase_batch_free(b);
+  close_input(in);
 }
 
-void wordgraph_free(struct WordGraph *g) {
-  int i;
-  for (i = 0; i < g->n_words; i++) {
-    free(g->words[i]);
-    free(g->followers_compressed[i]);
-  }
-  for (i = 0; i < g->n_prefixes; i++) {
-    intvec_free(g->prefixes[i].words);
-  }
-  free(g->words);
-  free(g->followers_compressed);
-  free(g);
-}
-
-/* decode an adjacency list encoded as a string */
-struct IntVec *decode(char *enc) {
-  /*
-  general encoding steps:
-  input: [1, 2, 3, 5, 80]
-  subtract previous value: [1, 1, 1, 2, 75]
-  subtract 1: [0, 0, 0, 1, 74]
-  contract runs of zeros: [0x3, 1, 74]
-  printably encode numbers as base-32 varints,
-  and runs of zeros as the 31 leftover characters:
-  output: "bA*B"
-
-  this function reverses the steps.
-
-  Cf. decode in digest.py
-  */
-  int enc_ind = 0;
-  struct IntVec *dec = intvec_alloc();
-  int last_num = 0;
-  int zero_run = 0;
-  while (enc[enc_ind] || zero_run) {
-    int delta = 0;
-    int delta_ind = 0;
-    if (zero_run)
-      zero_run--;
-    else {
-      unsigned char val = enc[enc_ind];
-      if (val >= 0x60) {
-        zero_run = enc[enc_ind] & 0x1f;
-        delta_ind++;
-      } else {
-        /* decode base-32 varint */
-        do {
-          val = enc[enc_ind + delta_ind];
-          delta |= (val & 0x1f) << (5 * delta_ind);
-          delta_ind++;
-        } while (val & 0x20);
-      }
+/* print the rank of each password in a file, one per line. Passwords that
+   can't be ranked leave an empty line. */
+void rank_passwords(struct WordGraph *g, const char *filename) {
+  FILE *in = open_input(filename);
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t len;
+  long line_no = 0;
+  uint64_t rank;
+  while ((len = getline(&line, &cap, in)) != -1) {
+    line_no++;
+    while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+      line[--len] = 0;
+    if (wordgraph_rank(g, line, &rank) < 0) {
+      warnx("line %ld: can't rank %s", line_no, line);
+      printf("\n");
+      continue;
+    }
+    printf("%llu\n", (unsigned long long)rank);
+  }
+  free(line);
+  close_input(in);
+}
+
+/* print the password of a given length for each rank in a file */
+void unrank_passwords(struct WordGraph *g, const char *filename, int length) {
+  FILE *in = open_input(filename);
+  char password[MAX_RANK_LEN * PREFIX_LEN + 1];
+  unsigned long long rank;
+  int n;
+  while ((n = fscanf(in, "%llu", &rank)) == 1) {
+    if (rank >> (length * PREFIX_BITS))
+      errx(4, "rank %llu is too large for %d prefixes", rank, length);
+    wordgraph_unrank(g, rank, length, password);
+    printf("%s\n", password);
+  }
+  if (n != EOF)
+    errx(4, "%s: ranks must be unsigned integers", filename);
+  close_input(in);
+}
+
+/* if line is an abbrase password, print it with its prefix indexes and
+   entropy */
+static void recognize_line(struct WordGraph *g, const char *line, size_t len) {
+  size_t i;
+  if (len && line[len - 1] == '\r')
+    len--;
+  if (!len || len % PREFIX_LEN)
+    return;
+  for (i = 0; i < len; i += PREFIX_LEN) {
+    int p = g->prefix_table[PREFIX_KEY(line + i)] - 1;
+    if (p < 0 || memcmp(g->prefixes[p].prefix, line + i, PREFIX_LEN))
+      return;
+  }
+  fwrite(line, 1, len, stdout);
+  for (i = 0; i < len; i += PREFIX_LEN)
+    printf("%c%d", i ? ' ' : '\t', g->prefix_table[PREFIX_KEY(line + i)] - 1);
+  printf("\t%ld\n", (long)(len / PREFIX_LEN * 10));
+}
+
+/* recognize the complete lines in buf, returning how many bytes were used */
+static size_t recognize_buffer(struct WordGraph *g, const char *buf,
+                               size_t len) {
+  const char *line = buf, *end = buf + len, *nl;
+  while ((nl = memchr(line, '\n', end - line))) {
+    recognize_line(g, line, nl - line);
+    line = nl + 1;
+  }
+  return line - buf;
+}
+
+/* print the lines of a file (- for stdin) that are abbrase passwords */
+void recognize_passwords(struct WordGraph *g, const char *filename) {
+  int fd = strcmp(filename, "-") ? open(filename, O_RDONLY) : 0;
+  struct stat st;
+  if (fd < 0)
+    err(1, "unable to open %s", filename);
+
+  /* regular files are mapped in one go */
+  if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+    char *buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (buf == MAP_FAILED)
+      err(1, "unable to map %s", filename);
+    madvise(buf, st.st_size, MADV_SEQUENTIAL);
+    size_t used = recognize_buffer(g, buf, st.st_size);
+    recognize_line(g, buf + used, st.st_size - used);
+    munmap(buf, st.st_size);
+    close(fd);
+    return;
+  }
+
+  size_t cap = 1 << 20, len = 0;
+  char *buf = malloc(cap);
+  ssize_t n;
+  while ((n = read(fd, buf + len, cap - len)) > 0) {
+    len += n;
+    size_t used = recognize_buffer(g, buf, len);
+    memmove(buf, buf + used, len - used);
+    len -= used;
+    /* a line longer than the buffer */
+    if (len == cap)
+      buf = realloc(buf, cap *= 2);
+  }
+  if (n < 0)
+    err(1, "unable to read %s", filename);
+  recognize_line(g, buf, len);
+  free(buf);
+  if (fd)
+    close(fd);
+}
+
+/* make a set of the ranks of the passwords of a given length in a ledger,
+   with room for extra more. A ledger has a password at the start of each
+   line, so the output of abbrase itself can be used. The ranks are read
+   before the set is sized, so it never grows while loading. */
+struct RankSet *load_ledger(struct WordGraph *g, const char *filename,
+                            int length, size_t extra) {
+  FILE *in = open_input(filename);
+  struct RankSet *issued;
+  char *line = NULL;
+  size_t cap = 0, loaded = 0, ranks_cap = 1024, i;
+  uint64_t rank, *ranks = malloc(sizeof(uint64_t) * ranks_cap);
+  while (getline(&line, &cap, in) != -1) {
+    line[strcspn(line, " \t\r\n")] = 0;
+    if (wordgraph_rank(g, line, &rank) == length) {
+      if (loaded == ranks_cap)
+        ranks = realloc(ranks, sizeof(uint64_t) * (ranks_cap *= 2));
+      if (!ranks)
+        err(8, "unable to allocate ledger ranks");
+      ranks[loaded++] = rank;
     }
-    enc_ind += delta_ind;
-    last_num += delta + 1;
-    intvec_append(dec, last_num);
   }
-  return dec;
+  fprintf(stderr, "ledger: %zu passwords of length %d in %s\n", loaded,
+          length, filename);
+  free(line);
+  close_input(in);
+
+  issued = rankset_alloc(loaded + extra);
+  for (i = 0; i < loaded; i++)
+    rankset_insert(issued, ranks[i]);
+  free(ranks);
+  return issued;
 }
 
-void wordgraph_dump(struct WordGraph *g, int a, int b) {
+/* random prefixes come from /dev/urandom, or with --seed from a
+   counter-based generator, which makes runs reproducible and resumable.
+   Anyone who knows the seed can reproduce the passwords, too. */
+struct Rng {
+  int fd;
+  int seeded;
+  uint64_t seed;
+  uint64_t counter; /* random numbers drawn so far */
+};
+
+static uint64_t splitmix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+void rng_fill(struct Rng *rng, int *out, int n) {
   int i;
-  for (i = a; i < b; i++) {
-    printf("#%d: %s: %.30s ", i, g->words[i], g->followers_compressed[i]);
-    struct IntVec *followers = decode(g->followers_compressed[i]);
-    intvec_print(followers);
-    intvec_free(followers);
-    printf("\n");
+  if (!rng->seeded) {
+    if (read(rng->fd, out, sizeof(int) * n) != (ssize_t)(sizeof(int) * n))
+      err(6, "unable to read random numbers");
+    rng->counter += n;
+    return;
   }
+  for (i = 0; i < n; i++)
+    out[i] = splitmix64(rng->seed + ++rng->counter * 0x9e3779b97f4a7c15ULL);
 }
 
-static int min(int a, int b) {
-  if (a <= b)
-    return a;
-  return b;
+/* pick series of prefixes that will make up n passwords. Passwords whose
+   rank is already in issued are drawn again, and new ones are added. */
+void draw_passwords(struct Rng *rng, int *prefixes_chosen, int length, int n,
+                    struct RankSet *issued) {
+  int i;
+  rng_fill(rng, prefixes_chosen, length * n);
+  for (i = 0; i < length * n; i++)
+    prefixes_chosen[i] &= MAX_PREFIXES - 1;
+  if (!issued)
+    return;
+  for (i = 0; i < n; i++) {
+    int *password = prefixes_chosen + i * length;
+    while (!rankset_insert(issued, wordgraph_rank_prefixes(password, length)))
+      draw_passwords(rng, password, length, 1, NULL);
+  }
+}
+
+/* a bulk generation run */
+struct GenerateJob {
+  struct WordGraph *g;
+  long length;
+  long count;
+  int start_word;
+  int n_threads;
+  struct RankSet *issued;  /* NULL unless --unique */
+  struct Rng rng;
+  const char *output;      /* NULL for stdout */
+  const char *checkpoint;  /* NULL for none */
+  double checkpoint_interval; /* seconds */
+  int n_shards;            /* 0 for a single output */
+  int shard_by_hash;       /* else by password index range */
+  int direct;
+  long long sync_bytes;
+};
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void print_header(FILE *out, struct GenerateJob *job) {
+  int i;
+  fprintf(out, "Generating %ld passwords with %ld bits of entropy\n",
+          job->count, job->length * 10);
+
+  if (job->start_word)
+    fprintf(out, "    hook: %s\n", job->g->words[job->start_word]);
+
+  int pass_len = job->length * 3;
+  fprintf(out, "%-*s    %s\n", pass_len, "Password", "Mnemonic");
+  for (i = 0; i < pass_len; i++)
+    putc('-', out);
+  fprintf(out, "    ");
+  for (i = 0; i < job->length * 4; i++)
+    putc('-', out);
+  fprintf(out, "\n");
 }
 
-int edit_distance(const char *a, const char *b) {
-  // code based off http://hetland.org/coding/python/levenshtein.py
+/* open the output of a job, cutting off anything written after the last
+   checkpoint when resuming */
+static FILE *open_output(const char *path, int resuming, long long offset,
+                         const char *mode) {
+  int fd = open(path, O_RDWR | O_CREAT | (resuming ? 0 : O_TRUNC), 0644);
+  if (fd < 0)
+    err(1, "unable to open %s", path);
+  if (resuming && ftruncate(fd, offset))
+    err(9, "unable to truncate %s", path);
+  if (lseek(fd, 0, SEEK_END) < 0)
+    err(9, "unable to seek in %s", path);
+  FILE *f = fdopen(fd, mode);
+  if (!f)
+    err(1, "unable to open %s", path);
+  return f;
+}
+
+/* reload the ranks issued before a checkpoint into the dedup set */
+static void load_rank_snapshot(struct RankSet *issued, FILE *ranks,
+                               long long n_ranks) {
+  uint64_t rank;
+  rewind(ranks);
+  while (n_ranks--) {
+    if (fread(&rank, sizeof rank, 1, ranks) != 1)
+      errx(9, "dedup snapshot is shorter than its checkpoint");
+    rankset_insert(issued, rank);
+  }
+  fseek(ranks, 0, SEEK_END);
+}
+
+/* draw and solve a batch of n passwords */
+static void generate_batch(struct GenerateJob *job, struct PhraseBatch *b,
+                           int *prefixes_chosen, int n) {
+  int i;
+  draw_passwords(&job->rng, prefixes_chosen, job->length, n, job->issued);
+  phrase_batch_clear(b);
+  for (i = 0; i < n; i++)
+    phrase_batch_add(b, prefixes_chosen + i * job->length, job->length);
+  phrase_batch_solve(b, job->n_threads);
+}
+
+/* pick the shard for the password with a given index */
+static int pick_shard(struct GenerateJob *job, long index,
+                      const int *prefixes_chosen) {
+  uint64_t hash = 0;
+  int i;
+  if (!job->shard_by_hash)
+    return (long long)index * job->n_shards / job->count;
+  for (i = 0; i < job->length; i++)
+    hash = splitmix64(hash + prefixes_chosen[i]);
+  return hash % job->n_shards;
+}
 
-  int n = strlen(a), m = strlen(b);
+void generate_passwords(struct GenerateJob *job) {
+  long length = job->length;
+  struct CheckpointState st = {0}, saved;
+  struct Checkpointer *cp = NULL;
+  struct ShardWriter *shards = NULL;
+  FILE *out = stdout, *ranks = NULL;
+  int fds[MAX_SHARDS + 1], n_fds = 0;
+  int resuming = 0;
+  int i;
 
-  if (n > m) {
-    // ensure n <= m, to use O(min(n,m)) space
-    const char *tmp_s = a;
-    a = b;
-    b = tmp_s;
-    int tmp_i = n;
-    n = m;
-    m = tmp_i;
+  st.length = length;
+  st.count = job->count;
+  st.seeded = job->rng.seeded;
+  st.seed = job->rng.seed;
+  st.n_shards = job->n_shards;
+  if (job->n_shards && !job->output)
+    errx(4, "--shards requires --output");
+  if (job->checkpoint) {
+    if (!job->output)
+      errx(4, "--checkpoint requires --output");
+    if (checkpoint_read(job->checkpoint, &saved)) {
+      if (saved.length != st.length || saved.count != st.count ||
+          saved.seeded != st.seeded || saved.seed != st.seed ||
+          saved.n_shards != st.n_shards)
+        errx(9, "%s is a checkpoint for a different job", job->checkpoint);
+      st = saved;
+      resuming = 1;
+    }
   }
 
-  int cost[n + 1];
+  if (job->n_shards) {
+    shards = shard_writer_open(job->output, job->n_shards, job->direct,
+                               job->sync_bytes, resuming ? st.shards : NULL);
+    shard_writer_fds(shards, fds);
+    n_fds = job->n_shards;
+  } else if (job->output) {
+    out = open_output(job->output, resuming, st.offset, "w");
+    fds[n_fds++] = fileno(out);
+  }
+  if (job->checkpoint && job->issued) {
+    size_t len = strlen(job->checkpoint) + 7;
+    char path[len];
+    snprintf(path, len, "%s.ranks", job->checkpoint);
+    ranks = open_output(path, resuming, st.n_ranks * sizeof(uint64_t), "w+");
+    if (resuming)
+      load_rank_snapshot(job->issued, ranks, st.n_ranks);
+    fds[n_fds++] = fileno(ranks);
+  }
+  if (job->issued && length < MAX_RANK_LEN &&
+      job->issued->len + (job->count - st.issued) > 1ULL << (length * PREFIX_BITS))
+    errx(4, "not enough unique passwords of length %ld", length);
 
-  int i, j;
-  int ins, del, sub;
-  int prevdiag; // lets us store only one row + one cell at a time
+  if (resuming) {
+    job->rng.counter = st.counter;
+    fprintf(stderr, "resuming at password %ld of %ld\n", st.issued,
+            st.count);
+  } else if (!shards) {
+    print_header(out, job);
+  }
+  if (job->checkpoint)
+    cp = checkpointer_start(job->checkpoint, fds, n_fds);
 
-  const int insert_cost = 1;
-  const int gap_cost = 1;
-  const int mismatch_cost = 1;
+  struct PhraseBatch *b = phrase_batch_alloc(job->g, job->start_word);
+  int *prefixes_chosen = malloc(sizeof(int) * length * BATCH_SIZE);
+  double last_checkpoint = now();
+  while (st.issued < job->count) {
+    long left = job->count - st.issued;
+    int n = left < BATCH_SIZE ? left : BATCH_SIZE;
+    generate_batch(job, b, prefixes_chosen, n);
+    for (i = 0; i < n; i++) {
+      if (shards) {
+        int shard = pick_shard(job, st.issued + i, prefixes_chosen + i * length);
+        phrase_batch_print(shard_writer_file(shards, shard), b, i);
+        shard_writer_count(shards, shard);
+      } else {
+        phrase_batch_print(out, b, i);
+      }
+    }
+    if (ranks) {
+      for (i = 0; i < n; i++) {
+        uint64_t rank =
+            wordgraph_rank_prefixes(prefixes_chosen + i * length, length);
+        fwrite(&rank, sizeof rank, 1, ranks);
+      }
+      st.n_ranks += n;
+    }
+    st.issued += n;
+    st.counter = job->rng.counter;
+    if (cp && (st.issued == job->count ||
+               now() - last_checkpoint >= job->checkpoint_interval)) {
+      if (shards) {
+        shard_writer_flush(shards);
+        shard_writer_state(shards, st.shards);
+      } else {
+        if (fflush(out))
+          err(9, "unable to write output");
+        st.offset = ftello(out);
+      }
+      if (ranks && fflush(ranks))
+        err(9, "unable to write dedup snapshot");
+      checkpointer_post(cp, &st);
+      last_checkpoint = now();
+    }
+  }
+  free(prefixes_chosen);
+  phrase_batch_free(b);
 
-  for (i = 0; i < n + 1; ++i)
-    cost[i] = i * insert_cost;
+  if (cp)
+    checkpointer_finish(cp);
+  if (shards) {
+    char description[128];
+    snprintf(description, sizeof description,
+             "abbrase-manifest length=%ld count=%ld bits=%ld shard-by=%s",
+             length, job->count, length * PREFIX_BITS,
+             job->shard_by_hash ? "hash" : "range");
+    shard_writer_close(shards, description);
+  }
+  if (ranks)
+    fclose(ranks);
+  if (out != stdout && fclose(out))
+    err(9, "unable to write %s", job->output);
+}
 
-  for (i = 1; i < m + 1; ++i) {
-    prevdiag = cost[0];
-    cost[0] = i * gap_cost;
+/* A seeded job can be split into ranges of password indexes, since
+   password i is made from random numbers i * length + 1 and up. With
+   --coordinate, ranges are handed to worker processes, which load the graph
+   once and then answer requests of "start count" on stdin with the lines
+   for those passwords, followed by a "." line. A worker that dies has its
+   range handed to a replacement, and the coordinator prints ranges in
+   order, so the output is the same as a single process run. */
+#define RANGE_SIZE (4 * BATCH_SIZE)
 
-    for (j = 1; j < n + 1; ++j) {
-      ins = cost[j] + gap_cost;
-      del = cost[j - 1] + gap_cost;
-      sub = prevdiag;
-      if (a[j - 1] != b[i - 1])
-        sub += mismatch_cost;
-      prevdiag = cost[j];
-      cost[j] = min(ins, min(del, sub));
+/* answer range requests from a coordinator */
+void run_worker(struct GenerateJob *job) {
+  struct PhraseBatch *b = phrase_batch_alloc(job->g, job->start_word);
+  int *prefixes_chosen = malloc(sizeof(int) * job->length * BATCH_SIZE);
+  long start, count;
+  int i;
+  while (scanf("%ld %ld", &start, &count) == 2) {
+    job->rng.counter = start * job->length;
+    while (count) {
+      int n = count < BATCH_SIZE ? count : BATCH_SIZE;
+      generate_batch(job, b, prefixes_chosen, n);
+      for (i = 0; i < n; i++)
+        phrase_batch_print(stdout, b, i);
+      count -= n;
     }
+    printf(".\n");
+    fflush(stdout);
+  }
+  free(prefixes_chosen);
+  phrase_batch_free(b);
+}
+
+struct Worker {
+  pid_t pid;
+  int to, from;  /* pipes to its stdin and from its stdout */
+  long range;    /* range being generated, or -1 when idle */
+  char *buf;     /* output so far */
+  size_t len, cap;
+};
+
+struct Range {
+  char *out;     /* output, once done */
+  size_t len;
+  int state;     /* 0 to do, 1 running, 2 done */
+};
+
+static const char *graph_file = "wordlist_bigrams.txt";
+static int succinct;
+
+static void worker_spawn(struct GenerateJob *job, struct Worker *w,
+                         int n_threads) {
+  int to[2], from[2];
+  char length[32], seed[32], hook[32], threads[32];
+  if (pipe2(to, O_CLOEXEC) || pipe2(from, O_CLOEXEC))
+    err(12, "unable to create worker pipes");
+  snprintf(length, sizeof length, "%ld", job->length);
+  snprintf(seed, sizeof seed, "%llu", (unsigned long long)job->rng.seed);
+  snprintf(hook, sizeof hook, "%d", job->start_word);
+  snprintf(threads, sizeof threads, "%d", n_threads);
+  w->pid = fork();
+  if (w->pid < 0)
+    err(12, "unable to start worker");
+  if (!w->pid) {
+    if (dup2(to[0], 0) < 0 || dup2(from[1], 1) < 0)
+      _exit(12);
+    char *args[] = {"abbrase", "--graph", (char *)graph_file, "--threads",
+                    threads, "--seed", seed, "--worker", length, hook,
+                    succinct ? "--succinct" : NULL, NULL};
+    execv("/proc/self/exe", args);
+    _exit(12);
   }
+  close(to[0]);
+  close(from[1]);
+  w->to = to[1];
+  w->from = from[0];
+  w->range = -1;
+  w->len = 0;
+}
 
-  return cost[n];
+static void worker_stop(struct Worker *w) {
+  close(w->to);
+  close(w->from);
+  waitpid(w->pid, NULL, 0);
 }
 
-/* find the closest word to the input */
-int wordgraph_find_word(struct WordGraph *g, const char *word) {
-  int i, best_word = 0, best_dist = 10000;
-  for (i = 1; i < g->n_words; i++) {
-    int dist = edit_distance(word, g->words[i]);
-    if (dist < best_dist) {
-      best_dist = dist;
-      best_word = i;
+/* hand a range to an idle worker. Returns 0 if the worker is gone. */
+static int worker_assign(struct GenerateJob *job, struct Worker *w,
+                         long range) {
+  char request[64];
+  long start = range * RANGE_SIZE;
+  long count = job->count - start < RANGE_SIZE ? job->count - start
+                                                : RANGE_SIZE;
+  int len = snprintf(request, sizeof request, "%ld %ld\n", start, count);
+  w->range = range;
+  w->len = 0;
+  return write(w->to, request, len) == len;
+}
+
+/* read what a worker has written. Returns -1 if it died, 1 if its range
+   is done, or 0 otherwise. */
+static int worker_read(struct Worker *w) {
+  if (w->cap - w->len < 65536) {
+    w->cap = w->cap * 2 + 65536;
+    w->buf = realloc(w->buf, w->cap);
+  }
+  ssize_t n = read(w->from, w->buf + w->len, w->cap - w->len);
+  if (n < 0 && errno == EINTR)
+    return 0;
+  if (n <= 0)
+    return -1;
+  w->len += n;
+  return w->len >= 2 && !memcmp(w->buf + w->len - 2, ".\n", 2) &&
+         (w->len == 2 || w->buf[w->len - 3] == '\n');
+}
+
+void coordinate_passwords(struct GenerateJob *job, int n_workers) {
+  long n_ranges = (job->count + RANGE_SIZE - 1) / RANGE_SIZE;
+  long next_out = 0, next_todo = 0, i;
+  int respawns = 0, j;
+  FILE *out = stdout;
+  if (!job->rng.seeded)
+    errx(4, "--coordinate requires --seed");
+  if (job->issued || job->checkpoint || job->n_shards)
+    errx(4, "--coordinate doesn't support --unique, --checkpoint or --shards");
+  if (job->output && !(out = fopen(job->output, "w")))
+    err(1, "unable to open %s", job->output);
+  signal(SIGPIPE, SIG_IGN);
+
+  struct Range *ranges = calloc(n_ranges, sizeof ranges[0]);
+  struct Worker workers[n_workers];
+  struct pollfd fds[n_workers];
+  int n_threads = job->n_threads / n_workers ? job->n_threads / n_workers : 1;
+  for (j = 0; j < n_workers; j++) {
+    workers[j].buf = NULL;
+    workers[j].cap = 0;
+    worker_spawn(job, &workers[j], n_threads);
+  }
+
+  print_header(out, job);
+  while (next_out < n_ranges) {
+    /* hand out ranges, oldest first */
+    for (j = 0; j < n_workers; j++) {
+      struct Worker *w = &workers[j];
+      while (w->range < 0 && next_todo < n_ranges) {
+        if (ranges[next_todo].state) {
+          next_todo++;
+          continue;
+        }
+        ranges[next_todo].state = 1;
+        if (!worker_assign(job, w, next_todo))
+          break; /* noticed as a death when polled */
+      }
+      fds[j].fd = w->range >= 0 ? w->from : -1;
+      fds[j].events = POLLIN;
+    }
+    if (poll(fds, n_workers, -1) < 0 && errno != EINTR)
+      err(12, "unable to wait for workers");
+    for (j = 0; j < n_workers; j++) {
+      struct Worker *w = &workers[j];
+      if (fds[j].fd < 0 || !fds[j].revents)
+        continue;
+      int status = worker_read(w);
+      if (status < 0) {
+        warnx("worker %d died, reassigning range %ld", w->pid, w->range);
+        if (++respawns > 3 * n_workers)
+          errx(12, "too many workers died");
+        ranges[w->range].state = 0;
+        if (w->range < next_todo)
+          next_todo = w->range;
+        worker_stop(w);
+        worker_spawn(job, w, n_threads);
+      } else if (status) {
+        struct Range *r = &ranges[w->range];
+        r->len = w->len - 2;
+        r->out = malloc(r->len);
+        memcpy(r->out, w->buf, r->len);
+        r->state = 2;
+        w->range = -1;
+      }
+    }
+    /* print finished ranges in order */
+    while (next_out < n_ranges && ranges[next_out].state == 2) {
+      fwrite(ranges[next_out].out, 1, ranges[next_out].len, out);
+      free(ranges[next_out].out);
+      ranges[next_out].out = NULL;
+      next_out++;
     }
   }
-  return best_word;
+
+  for (j = 0; j < n_workers; j++) {
+    worker_stop(&workers[j]);
+    free(workers[j].buf);
+  }
+  for (i = 0; i < n_ranges; i++)
+    free(ranges[i].out);
+  free(ranges);
+  if (fclose(out))
+    err(1, "unable to write output");
 }
 
+static void print_stats() { stats_print(stderr); }
+
+static void print_perf_counters() { perf_print(stderr); }
+
 int main(int argc, char *argv[]) {
-  struct WordGraph *g = wordgraph_init("wordlist_bigrams.txt");
+  int i, perf_counters = 0, validate = 0;
+
+  /* counters have to be running before the graph is loaded, and the graph
+     is loaded before the other options are parsed */
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--perf-counters"))
+      perf_counters = 1;
+    else if (!strcmp(argv[i], "--validate"))
+      validate = 1;
+    else if (!strcmp(argv[i], "--succinct"))
+      succinct = 1;
+    else if (!strcmp(argv[i], "--graph") && i + 1 < argc)
+      graph_file = argv[++i];
+  }
+  if (perf_counters) {
+    perf_open();
+    atexit(print_perf_counters);
+  }
+
+  struct WordGraph *g = wordgraph_init(graph_file);
+  if (validate && !g->validated &&
+      wordgraph_validate(g, sysconf(_SC_NPROCESSORS_ONLN)) >= 0)
+    errx(3, "%s is invalid", graph_file);
+  if (succinct)
+    wordgraph_succinct(g);
   // wordgraph_dump(g, 1, 3000)
 
   long length = 0;
   long count = 0;
   int start_word = 0;
-  int i, j;
+  const char *passwords_file = NULL;
+  const char *recognize_file = NULL;
+  const char *rank_file = NULL;
+  const char *unrank_file = NULL;
+  const char *ledger_file = NULL;
+  int unique = 0;
+  struct GenerateJob job = {0};
+  int n_workers = 0, worker = 0;
+  job.checkpoint_interval = 10;
+  long n_threads = sysconf(_SC_NPROCESSORS_ONLN);
 
   if( argc > 1 &&
     (strcmp(argv[1],"-h") == 0 || strcmp(argv[1],"--help") == 0)
     ){
-    printf("Usage: abbrase <number of bits/10> <number of passwords> <start word>\n");
+    printf("Usage: abbrase [options] <number of bits/10> <number of passwords> <start word>\n"
+           "\n"
+           "  --from-passwords FILE  print mnemonics for the passwords in FILE\n"
+           "                         (one per line, - for stdin)\n"
+           "  --recognize FILE       print the lines of FILE that are abbrase\n"
+           "                         passwords, with prefix indexes and entropy\n"
+           "  --rank FILE            print the 64-bit rank of each password in FILE\n"
+           "  --unrank FILE          print the password for each rank in FILE\n"
+           "  --unique               never issue the same password twice\n"
+           "  --ledger FILE          with --unique, also avoid the passwords in FILE\n"
+           "  --output FILE          write passwords to FILE instead of stdout\n"
+           "  --checkpoint FILE      checkpoint progress to FILE, and resume from\n"
+           "                         it if it exists (requires --output)\n"
+           "  --checkpoint-interval SECONDS\n"
+           "                         time between checkpoints (default 10)\n"
+           "  --shards N             split --output into N files, FILE.000 to\n"
+           "                         FILE.<N-1>, listed in FILE.manifest\n"
+           "  --shard-by range|hash  assign passwords to shards by index range\n"
+           "                         (the default) or by hash\n"
+           "  --direct               write shards with O_DIRECT\n"
+           "  --sync-mb N            fdatasync each shard every N MB\n"
+           "  --seed N               draw prefixes from a generator seeded with N\n"
+           "                         instead of /dev/urandom. Passwords are only as\n"
+           "                         secret as the seed!\n"
+           "  --coordinate N         split a --seed job over N worker processes\n"
+           "  --threads N            number of solver threads\n"
+           "  --stats                print timings and counters to stderr\n"
+           "  --perf-counters        print hardware counters for each phase to\n"
+           "                         stderr (runs the solver on one thread)\n"
+           "  --graph FILE           load the word graph from FILE, text or binary\n"
+           "                         (default wordlist_bigrams.txt)\n"
+           "  --validate             check every follower list of the graph before\n"
+           "                         using it, unless graphcheck already did\n"
+           "  --succinct             keep the follower lists Elias-Fano coded, which\n"
+           "                         takes a little less memory and is faster\n");
     exit(0);
   }
 
   for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--from-passwords")) {
+      if (++i == argc)
+        errx(4, "--from-passwords requires a file name");
+      passwords_file = argv[i];
+      continue;
+    } else if (!strcmp(argv[i], "--recognize")) {
+      if (++i == argc)
+        errx(4, "--recognize requires a file name");
+      recognize_file = argv[i];
+      continue;
+    } else if (!strcmp(argv[i], "--rank")) {
+      if (++i == argc)
+        errx(4, "--rank requires a file name");
+      rank_file = argv[i];
+      continue;
+    } else if (!strcmp(argv[i], "--unrank")) {
+      if (++i == argc)
+        errx(4, "--unrank requires a file name");
+      unrank_file = argv[i];
+      continue;
+    } else if (!strcmp(argv[i], "--unique")) {
+      unique = 1;
+      continue;
+    } else if (!strcmp(argv[i], "--ledger")) {
+      if (++i == argc)
+        errx(4, "--ledger requires a file name");
+      ledger_file = argv[i];
+      unique = 1;
+      continue;
+    } else if (!strcmp(argv[i], "--output")) {
+      if (++i == argc)
+        errx(4, "--output requires a file name");
+      job.output = argv[i];
+      continue;
+    } else if (!strcmp(argv[i], "--checkpoint")) {
+      if (++i == argc)
+        errx(4, "--checkpoint requires a file name");
+      job.checkpoint = argv[i];
+      continue;
+    } else if (!strcmp(argv[i], "--checkpoint-interval")) {
+      char *end;
+      if (++i == argc ||
+          !((job.checkpoint_interval = strtod(argv[i], &end)) > 0) ||
+          end == argv[i] || *end)
+        errx(4, "--checkpoint-interval requires a positive number of seconds");
+      continue;
+    } else if (!strcmp(argv[i], "--shards")) {
+      if (++i == argc || (job.n_shards = atoi(argv[i])) < 1 ||
+          job.n_shards > MAX_SHARDS)
+        errx(4, "--shards requires a number from 1 to %d", MAX_SHARDS);
+      continue;
+    } else if (!strcmp(argv[i], "--shard-by")) {
+      if (++i == argc ||
+          (strcmp(argv[i], "range") && strcmp(argv[i], "hash")))
+        errx(4, "--shard-by requires range or hash");
+      job.shard_by_hash = !strcmp(argv[i], "hash");
+      continue;
+    } else if (!strcmp(argv[i], "--direct")) {
+      job.direct = 1;
+      continue;
+    } else if (!strcmp(argv[i], "--sync-mb")) {
+      char *end;
+      long long mb;
+      errno = 0;
+      if (++i == argc || (mb = strtoll(argv[i], &end, 10)) <= 0 || errno ||
+          end == argv[i] || *end || mb > LLONG_MAX >> 20)
+        errx(4, "--sync-mb requires a positive number");
+      job.sync_bytes = mb << 20;
+      continue;
+    } else if (!strcmp(argv[i], "--seed")) {
+      if (++i == argc)
+        errx(4, "--seed requires a number");
+      job.rng.seeded = 1;
+      job.rng.seed = strtoull(argv[i], NULL, 0);
+      continue;
+    } else if (!strcmp(argv[i], "--coordinate")) {
+      if (++i == argc || (n_workers = atoi(argv[i])) < 1)
+        errx(4, "--coordinate requires a positive number of workers");
+      continue;
+    } else if (!strcmp(argv[i], "--worker")) {
+      /* internal: --worker LENGTH HOOK, see run_worker */
+      if (i + 2 >= argc)
+        errx(4, "--worker requires a length and hook");
+      length = atol(argv[++i]);
+      start_word = atoi(argv[++i]);
+      worker = 1;
+      continue;
+    } else if (!strcmp(argv[i], "--stats")) {
+      atexit(print_stats);
+      continue;
+    } else if (!strcmp(argv[i], "--perf-counters") ||
+               !strcmp(argv[i], "--validate") ||
+               !strcmp(argv[i], "--succinct")) {
+      continue; /* handled above */
+    } else if (!strcmp(argv[i], "--graph")) {
+      i++; /* handled above */
+      continue;
+    } else if (!strcmp(argv[i], "--threads")) {
+      if (++i == argc || (n_threads = strtol(argv[i], NULL, 10)) <= 0)
+        errx(4, "--threads requires a positive number");
+      continue;
+    }
     errno = 0;
     if (length == 0) {
       length = strtol(argv[i], NULL, 10);
@@ -312,100 +1002,68 @@ int main(int argc, char *argv[]) {
     start_word = wordgraph_find_word(g, argv[i]);
   }
 
-  if (!length)
-    length = 5;
+  if (n_threads <= 0 || perf_counters)
+    n_threads = 1;
 
-  if (!count)
-    count = 32;
+  if (recognize_file) {
+    recognize_passwords(g, recognize_file);
+    wordgraph_free(g);
+    return 0;
+  }
 
-  int fd_crypto;
-  if ((fd_crypto = open("/dev/urandom", O_RDONLY)) < 0)
-    err(5, "unable to get secure random numbers");
+  if (rank_file) {
+    rank_passwords(g, rank_file);
+    wordgraph_free(g);
+    return 0;
+  }
 
-  printf("Generating %ld passwords with %ld bits of entropy\n", count,
-         length * 10);
+  if (passwords_file) {
+    regenerate_passwords(g, passwords_file, start_word, n_threads);
+    wordgraph_free(g);
+    return 0;
+  }
 
-  if (start_word)
-    printf("    hook: %s\n", g->words[start_word]);
+  if (!length)
+    length = 5;
 
-  int pass_len = length * 3;
-  printf("%-*s    %s\n", pass_len, "Password", "Mnemonic");
-  for (i = 0; i < pass_len; i++)
-    putchar('-');
-  printf("    ");
-  for (i = 0; i < length * 4; i++)
-    putchar('-');
-  printf("\n");
-
-  while (count--) {
-    /* pick series of prefixes that will make up the passwords */
-    int prefixes_chosen[length];
-    if (read(fd_crypto, prefixes_chosen, sizeof(prefixes_chosen)) !=
-        sizeof(prefixes_chosen))
-      err(6, "unable to read random numbers");
-    /* find possible words for each of the chosen prefixes */
-    struct IntVec *word_sets[length];
-    for (i = 0; i < length; i++) {
-      prefixes_chosen[i] &= MAX_PREFIXES - 1;
-      printf("%.3s", g->prefixes[prefixes_chosen[i]].prefix);
-      word_sets[i] = intvec_copy(g->prefixes[prefixes_chosen[i]].words);
-    }
+  if (unrank_file) {
+    if (length > MAX_RANK_LEN)
+      errx(4, "ranks hold at most %d prefixes", MAX_RANK_LEN);
+    unrank_passwords(g, unrank_file, length);
+    wordgraph_free(g);
+    return 0;
+  }
 
-    printf("   ");
-
-    /* working backwards, reduce possible words for each prefix to only
-       those words that have a link to a word in the next set of possible words
-     */
-    int mismatch = 0; /* track how many links were impossible */
-    struct IntVec *next_words, *new_words, *followers, *words, *intersect;
-    next_words = NULL;
-    for (i = length - 1; i >= 0; i--) {
-      words = word_sets[i];
-      new_words = intvec_alloc();
-      if (next_words) {
-        for (j = 0; j < words->len; j++) {
-          int word = intvec_get(words, j);
-          followers = decode(g->followers_compressed[word]);
-          intersect = intvec_intersect(next_words, followers);
-          if (intersect->len)
-            intvec_append(new_words, word);
-          intvec_free(intersect);
-          intvec_free(followers);
-        }
-      }
-      if (new_words->len) {
-        intvec_free(word_sets[i]);
-        word_sets[i] = new_words;
-      } else {
-        intvec_free(new_words);
-        mismatch++;
-      }
+  if (!count)
+    count = 32;
 
-      next_words = word_sets[i];
-    }
+  job.g = g;
+  job.length = length;
+  job.count = count;
+  job.start_word = start_word;
+  job.n_threads = n_threads;
+  if (unique) {
+    if (length > MAX_RANK_LEN)
+      errx(4, "--unique supports at most %d prefixes", MAX_RANK_LEN);
+    job.issued = ledger_file ? load_ledger(g, ledger_file, length, count)
+                             : rankset_alloc(count);
+  }
 
-    /* working forwards, pick a word for each prefix */
-    int last_word = start_word;
-    if (last_word)
-      printf(" %s", g->words[last_word]);
-    for (i = 0; i < length; i++) {
-      followers = decode(g->followers_compressed[last_word]);
-      intersect = intvec_intersect(word_sets[i], followers);
-      /* Picking the first word available biases the phrase towards more
-       * common words, and produces generally satisfactory results.
-       * N.B.: to save space, adjacency lists don't encode probabilities */
-      last_word = intvec_get(intersect->len ? intersect : word_sets[i], 0);
-      printf("%c", intersect->len ? ' ': ' ');
-      printf("%s", g->words[last_word]);
-      intvec_free(followers);
-      intvec_free(intersect);
-    }
+  if (!job.rng.seeded && (job.rng.fd = open("/dev/urandom", O_RDONLY)) < 0)
+    err(5, "unable to get secure random numbers");
 
-    for (i = 0; i < length; i++) {
-      intvec_free(word_sets[i]);
-    }
+  if (worker)
+    run_worker(&job);
+  else if (n_workers)
+    coordinate_passwords(&job, n_workers);
+  else
+    generate_passwords(&job);
 
-    printf("\n");
+  if (job.issued) {
+    fprintf(stderr, "unique: %zu ranks in %.1f MB (%.1f bytes each)\n",
+            job.issued->len, rankset_bytes(job.issued) / 1e6,
+            (double)rankset_bytes(job.issued) / job.issued->len);
+    rankset_free(job.issued);
   }
 
   wordgraph_free(g);
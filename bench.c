@@ -0,0 +1,323 @@
+/* micro-benchmarks for the wordgraph hot paths, printed as JSON.
+   Compare two runs with bench_compare.py. The graph is
+   wordlist_bigrams.txt, or the file given as the only argument, such as
+   one from gengraph. */
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "blockcode.h"
+#include "eliasfano.h"
+#include "wordgraph.h"
+
+#define GRAPH_FILE "wordlist_bigrams.txt"
+
+static const char *graph_file = GRAPH_FILE;
+#define MIN_SECONDS 0.5
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* deterministic, so every run measures the same work */
+static uint64_t rng_state = 12345;
+
+static uint64_t rng_next() {
+  uint64_t x = (rng_state += 0x9e3779b97f4a7c15ULL);
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static int first_result = 1;
+
+static void result(const char *name, double value, const char *unit) {
+  printf("%s\n    \"%s\": {\"value\": %.6g, \"unit\": \"%s\"}",
+         first_result ? "" : ",", name, value, unit);
+  first_result = 0;
+}
+
+static void bench_load() {
+  int runs = 0;
+  double start = now(), elapsed;
+  do {
+    wordgraph_free(wordgraph_init(graph_file));
+    runs++;
+  } while ((elapsed = now() - start) < MIN_SECONDS);
+  result("load_ms", elapsed / runs * 1e3, "ms");
+}
+
+/* the follower lists block coded, built by bench_blocks */
+static uint8_t **blocks;
+
+/* block code every follower list, as graphcheck -b does */
+static void bench_blocks(struct WordGraph *g) {
+  size_t bytes = 0;
+  int i;
+  blocks = malloc((g->n_words + 1) * sizeof blocks[0]);
+  double start = now();
+  for (i = 0; i < g->n_words; i++) {
+    struct IntVec *followers = decode(g->followers_compressed[i]);
+    blocks[i] = malloc(block_bound(followers->len) + BLOCK_PAD);
+    bytes += block_encode(followers->data, followers->len, blocks[i]);
+    intvec_free(followers);
+  }
+  blocks[g->n_words] = NULL;
+  result("block_build_ms", (now() - start) * 1e3, "ms");
+  result("block_followers_mb", bytes / 1e6, "MB");
+}
+
+/* decode every follower list whose length is in [lo, hi), or at least lo
+   if hi is 0, from the printable lists and then the block coded ones */
+static void bench_decode(struct WordGraph *g, int lo, int hi) {
+  int i, n_lists = 0;
+  int *lists = malloc(sizeof(int) * g->n_words);
+  for (i = 0; i < g->n_words; i++) {
+    struct IntVec *followers = decode(g->followers_compressed[i]);
+    if (followers->len >= lo && (!hi || followers->len < hi))
+      lists[n_lists++] = i;
+    intvec_free(followers);
+  }
+  long long ints = 0, bytes = 0;
+  double start = now(), elapsed;
+  do {
+    for (i = 0; i < n_lists; i++) {
+      struct IntVec *followers = decode(g->followers_compressed[lists[i]]);
+      ints += followers->len;
+      bytes += strlen(g->followers_compressed[lists[i]]);
+      intvec_free(followers);
+    }
+  } while ((elapsed = now() - start) < MIN_SECONDS && n_lists);
+  char bucket[32], name[64];
+  if (hi)
+    snprintf(bucket, sizeof bucket, "%d_%d", lo, hi);
+  else
+    snprintf(bucket, sizeof bucket, "%d_up", lo);
+  snprintf(name, sizeof name, "decode_%s_mints_per_s", bucket);
+  result(name, ints / elapsed / 1e6, "M ints/s");
+  snprintf(name, sizeof name, "decode_%s_mb_per_s", bucket);
+  result(name, bytes / elapsed / 1e6, "MB/s");
+
+  int *out = malloc(sizeof(int) * (g->n_words + 3));
+  ints = 0;
+  start = now();
+  do {
+    for (i = 0; i < n_lists; i++) {
+      block_decode(blocks[lists[i]], out);
+      ints += block_count(blocks[lists[i]]);
+    }
+  } while ((elapsed = now() - start) < MIN_SECONDS && n_lists);
+  snprintf(name, sizeof name, "block_decode_%s_mints_per_s", bucket);
+  result(name, ints / elapsed / 1e6, "M ints/s");
+  free(out);
+  free(lists);
+}
+
+/* the memory taken by the follower lists, then switch to Elias-Fano coded
+   ones */
+static void bench_succinct(struct WordGraph *g) {
+  size_t text_bytes = g->n_words * sizeof g->followers_compressed[0];
+  int i;
+  for (i = 0; i < g->n_words; i++)
+    text_bytes += strlen(g->followers_compressed[i]) + 1;
+  result("text_followers_mb", text_bytes / 1e6, "MB");
+
+  double start = now();
+  wordgraph_succinct(g);
+  result("succinct_build_ms", (now() - start) * 1e3, "ms");
+  result("succinct_followers_mb", ef_bytes(g->succinct) / 1e6, "MB");
+}
+
+/* look up every follower of random lists by position, and with
+   ef_next_geq one past each one */
+static void bench_succinct_access(struct WordGraph *g) {
+  long long ints = 0;
+  int i;
+  double start = now(), elapsed;
+  do {
+    for (i = 0; i < 64; i++) {
+      int word = rng_next() % g->n_words, j, x = 0;
+      int len = g->succinct->len[word];
+      for (j = 0; j < len; j++)
+        x += ef_get(g->succinct, word, j);
+      ints += len;
+      asm volatile("" : : "r"(x));
+    }
+  } while ((elapsed = now() - start) < MIN_SECONDS);
+  result("succinct_get_mints_per_s", ints / elapsed / 1e6, "M ints/s");
+
+  ints = 0;
+  start = now();
+  do {
+    for (i = 0; i < 64; i++) {
+      int word = rng_next() % g->n_words, x = 0;
+      while ((x = ef_next_geq(g->succinct, word, x + 1)) < g->n_words)
+        ints++;
+    }
+  } while ((elapsed = now() - start) < MIN_SECONDS);
+  result("succinct_next_geq_mints_per_s", ints / elapsed / 1e6, "M ints/s");
+}
+
+/* intersect random pairs of follower lists whose lengths differ by about
+   a given ratio, then the smaller of each with the block coded larger one */
+static void bench_intersect(struct WordGraph *g, int ratio) {
+  struct IntVec *small[256], *large[256];
+  int large_word[256], n = 0, tries = 0;
+  while (n < 256 && tries++ < 1000000) {
+    int wa = rng_next() % g->n_words, wb = rng_next() % g->n_words;
+    struct IntVec *a = decode(g->followers_compressed[wa]);
+    struct IntVec *b = decode(g->followers_compressed[wb]);
+    if (a->len > b->len) {
+      struct IntVec *tmp = a;
+      a = b;
+      b = tmp;
+      wb = wa;
+    }
+    if (a->len >= 8 && b->len >= a->len * ratio && b->len < a->len * ratio * 2) {
+      small[n] = a;
+      large_word[n] = wb;
+      large[n++] = b;
+    } else {
+      intvec_free(a);
+      intvec_free(b);
+    }
+  }
+  long long scanned = 0;
+  int i;
+  double start = now(), elapsed;
+  do {
+    for (i = 0; i < n; i++) {
+      intvec_free(intvec_intersect(small[i], large[i]));
+      scanned += small[i]->len + large[i]->len;
+    }
+  } while ((elapsed = now() - start) < MIN_SECONDS && n);
+  char name[64];
+  snprintf(name, sizeof name, "intersect_1_%d_melems_per_s", ratio);
+  result(name, scanned / elapsed / 1e6, "M elements/s");
+
+  int out[g->n_words];
+  scanned = 0;
+  start = now();
+  do {
+    for (i = 0; i < n; i++) {
+      block_intersect(blocks[large_word[i]], small[i]->data, small[i]->len,
+                      out);
+      scanned += small[i]->len + large[i]->len;
+    }
+  } while ((elapsed = now() - start) < MIN_SECONDS && n);
+  snprintf(name, sizeof name, "block_intersect_1_%d_melems_per_s", ratio);
+  result(name, scanned / elapsed / 1e6, "M elements/s");
+  for (i = 0; i < n; i++) {
+    intvec_free(small[i]);
+    intvec_free(large[i]);
+  }
+}
+
+static void bench_find_word(struct WordGraph *g) {
+  const char *words[] = {"dog", "mnemonic", "abbreviation", "xyzzy",
+                         "phrase", "internationalization"};
+  int n = sizeof words / sizeof words[0], i, runs = 0;
+  double start = now(), elapsed;
+  do {
+    for (i = 0; i < n; i++)
+      wordgraph_find_word(g, words[i]);
+    runs += n;
+  } while ((elapsed = now() - start) < MIN_SECONDS);
+  result("find_word_us", elapsed / runs * 1e6, "us");
+}
+
+static void bench_generate(struct WordGraph *g, const char *mode,
+                           int length) {
+  int prefixes[length], words[length], i;
+  long passwords = 0;
+  double start = now(), elapsed;
+  do {
+    for (i = 0; i < length; i++)
+      prefixes[i] = rng_next() & (MAX_PREFIXES - 1);
+    wordgraph_phrase(g, prefixes, length, 0, words);
+    passwords++;
+  } while ((elapsed = now() - start) < MIN_SECONDS);
+  char name[64];
+  snprintf(name, sizeof name, "%s_len%d_per_s", mode, length);
+  result(name, passwords / elapsed, "passwords/s");
+}
+
+/* generate from the graph in the binary format, with and without the skip
+   tables of its long follower lists */
+static void bench_skips(struct WordGraph *g) {
+  char path[] = "/tmp/abbrase_bench_XXXXXX";
+  int fd = mkstemp(path), validated = g->validated;
+  if (fd < 0)
+    err(1, "unable to create %s", path);
+  close(fd);
+  /* validated, so abbrase would use the skip tables */
+  wordgraph_validate(g, 1);
+  wordgraph_write_binary(g, path, 0);
+  g->validated = validated;
+  struct WordGraph *binary = wordgraph_init(path);
+  unlink(path);
+  const struct SkipEntry *skips = binary->skips;
+  size_t n_skips = binary->skip_offs[binary->n_words];
+  result("skip_table_mb", (n_skips * sizeof skips[0] +
+                           (binary->n_words + 1) * sizeof(uint64_t)) / 1e6,
+         "MB");
+  binary->skips = NULL;
+  bench_generate(binary, "binary_generate", 3);
+  bench_generate(binary, "binary_generate", 5);
+  bench_generate(binary, "binary_generate", 8);
+  binary->skips = skips;
+  bench_generate(binary, "skip_generate", 3);
+  bench_generate(binary, "skip_generate", 5);
+  bench_generate(binary, "skip_generate", 8);
+  wordgraph_free(binary);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 2)
+    errx(1, "usage: %s [graph]", argv[0]);
+  if (argc == 2)
+    graph_file = argv[1];
+  struct WordGraph *g = wordgraph_init(graph_file);
+  int i;
+  printf("{");
+  bench_load();
+  bench_blocks(g);
+  bench_decode(g, 1, 16);
+  bench_decode(g, 16, 256);
+  bench_decode(g, 256, 4096);
+  bench_decode(g, 4096, 0);
+  bench_intersect(g, 1);
+  bench_intersect(g, 10);
+  bench_intersect(g, 100);
+  bench_find_word(g);
+  bench_generate(g, "generate", 3);
+  bench_generate(g, "generate", 5);
+  bench_generate(g, "generate", 8);
+  /* generate from the block coded lists, which take precedence */
+  g->blocks = blocks;
+  bench_generate(g, "block_generate", 3);
+  bench_generate(g, "block_generate", 5);
+  bench_generate(g, "block_generate", 8);
+  g->blocks = NULL;
+  for (i = 0; i < g->n_words; i++)
+    free(blocks[i]);
+  free(blocks);
+  bench_skips(g);
+  bench_succinct(g);
+  bench_succinct_access(g);
+  bench_generate(g, "succinct_generate", 3);
+  bench_generate(g, "succinct_generate", 5);
+  bench_generate(g, "succinct_generate", 8);
+  printf("\n}\n");
+  wordgraph_free(g);
+  return 0;
+}
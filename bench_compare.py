@@ -0,0 +1,49 @@
+#!/usr/bin/env python
+''' compare two runs of abbrase_bench, flagging regressions
+
+usage: bench_compare.py baseline.json new.json [threshold]
+
+threshold is the fractional change that counts as a regression
+(default 0.1, i.e. 10%). Exits with status 1 if any benchmark regressed.
+'''
+
+from __future__ import print_function
+
+import json
+import sys
+
+# for these units, smaller is better
+LOWER_IS_BETTER = ('ms', 'us')
+
+
+def compare(baseline, new, threshold):
+    regressions = 0
+    for name in sorted(new):
+        if name not in baseline:
+            print('%-36s %12.4g %s (new)' % (name, new[name]['value'],
+                                             new[name]['unit']))
+            continue
+        old_value = baseline[name]['value']
+        new_value = new[name]['value']
+        unit = new[name]['unit']
+        change = (new_value - old_value) / old_value if old_value else 0.0
+        if unit in LOWER_IS_BETTER:
+            change = -change
+        flag = ''
+        if change < -threshold:
+            flag = '  REGRESSION'
+            regressions += 1
+        elif change > threshold:
+            flag = '  improved'
+        print('%-36s %12.4g -> %12.4g %-14s %+6.1f%%%s' % (
+            name, old_value, new_value, unit, 100 * change, flag))
+    return regressions
+
+
+if __name__ == '__main__':
+    if len(sys.argv) not in (3, 4):
+        sys.exit(__doc__)
+    baseline = json.load(open(sys.argv[1]))
+    new = json.load(open(sys.argv[2]))
+    threshold = float(sys.argv[3]) if len(sys.argv) == 4 else 0.1
+    sys.exit(1 if compare(baseline, new, threshold) else 0)
@@ -0,0 +1,236 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "blockcode.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/* for each control byte, the shuffle that spreads its four differences
+   into 32-bit lanes, and the number of data bytes they take */
+static uint8_t shuffles[256][16];
+static uint8_t lengths[256];
+
+static void decode_block_sw(const uint8_t *control, const uint8_t *data,
+                            int len, uint32_t prev, int *out);
+
+/* the decoder for this CPU, picked once at startup */
+static void (*decode_block_fn)(const uint8_t *control, const uint8_t *data,
+                               int len, uint32_t prev,
+                               int *out) = decode_block_sw;
+
+#if defined(__x86_64__)
+static void decode_block_ssse3(const uint8_t *control, const uint8_t *data,
+                               int len, uint32_t prev, int *out);
+#endif
+
+/* fill the tables before main, so threads never race to build them */
+__attribute__((constructor)) static void init_tables() {
+  int c, i, j;
+  for (c = 0; c < 256; c++) {
+    int pos = 0;
+    for (i = 0; i < 4; i++) {
+      int len = (c >> 2 * i & 3) + 1;
+      for (j = 0; j < 4; j++)
+        shuffles[c][4 * i + j] = j < len ? pos + j : 0x80;
+      pos += len;
+    }
+    lengths[c] = pos;
+  }
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("ssse3"))
+    decode_block_fn = decode_block_ssse3;
+#endif
+}
+
+static uint32_t get32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof v);
+  return v;
+}
+
+static void put32(uint8_t *p, uint32_t v) { memcpy(p, &v, sizeof v); }
+
+struct Layout {
+  int n, n_blocks;
+  const uint8_t *headers, *control, *data;
+};
+
+static void layout(const uint8_t *list, struct Layout *l) {
+  l->n = get32(list);
+  l->n_blocks = (l->n + BLOCK_LEN - 1) / BLOCK_LEN;
+  l->headers = list + 4;
+  l->control = l->headers + 8 * (size_t)l->n_blocks;
+  l->data = l->control + (l->n + 3) / 4;
+}
+
+static uint32_t block_max(const struct Layout *l, int block) {
+  return get32(l->headers + 8 * (size_t)block);
+}
+
+static uint32_t block_data(const struct Layout *l, int block) {
+  return block ? get32(l->headers + 8 * (size_t)block - 4) : 0;
+}
+
+size_t block_bound(int n) {
+  return 4 + 8 * (size_t)((n + BLOCK_LEN - 1) / BLOCK_LEN) + (n + 3) / 4 +
+         4 * (size_t)n;
+}
+
+size_t block_encode(const int *nums, int n, uint8_t *out) {
+  int n_blocks = (n + BLOCK_LEN - 1) / BLOCK_LEN, i;
+  uint8_t *control = out + 4 + 8 * (size_t)n_blocks;
+  uint8_t *data = control + (n + 3) / 4;
+  uint32_t prev = 0, pos = 0;
+
+  put32(out, n);
+  memset(control, 0, (n + 3) / 4);
+  for (i = 0; i < n; i++) {
+    uint32_t delta = nums[i] - prev;
+    int code = delta < 1 << 8 ? 0 : delta < 1 << 16 ? 1 : delta < 1 << 24 ? 2
+                                                                          : 3;
+    control[i / 4] |= code << 2 * (i % 4);
+    memcpy(data + pos, &delta, code + 1);
+    pos += code + 1;
+    prev = nums[i];
+    if (i % BLOCK_LEN == BLOCK_LEN - 1 || i == n - 1) {
+      put32(out + 4 + 8 * (size_t)(i / BLOCK_LEN), prev);
+      put32(out + 8 + 8 * (size_t)(i / BLOCK_LEN), pos);
+    }
+  }
+  return data + pos - out;
+}
+
+int block_count(const uint8_t *list) { return get32(list); }
+
+size_t block_size(const uint8_t *list) {
+  struct Layout l;
+  layout(list, &l);
+  return l.data + block_data(&l, l.n_blocks) - list;
+}
+
+static void decode_block_sw(const uint8_t *control, const uint8_t *data,
+                            int len, uint32_t prev, int *out) {
+  int i;
+  for (i = 0; i < len; i++) {
+    int n_bytes = (control[i / 4] >> 2 * (i % 4) & 3) + 1;
+    uint32_t delta = 0;
+    memcpy(&delta, data, n_bytes);
+    data += n_bytes;
+    out[i] = prev += delta;
+  }
+}
+
+#if defined(__x86_64__)
+/* Writes whole groups of four, so up to 3 numbers past len. */
+__attribute__((target("ssse3"))) static void
+decode_block_ssse3(const uint8_t *control, const uint8_t *data, int len,
+                   uint32_t prev, int *out) {
+  __m128i last = _mm_set1_epi32(prev);
+  int i;
+  for (i = 0; i < len; i += 4) {
+    uint8_t c = control[i / 4];
+    __m128i v = _mm_loadu_si128((const __m128i *)data);
+    v = _mm_shuffle_epi8(v, _mm_loadu_si128((const __m128i *)shuffles[c]));
+    data += lengths[c];
+    /* prefix sum of the four differences, plus the number before them */
+    v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+    v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+    v = _mm_add_epi32(v, last);
+    _mm_storeu_si128((__m128i *)(out + i), v);
+    last = _mm_shuffle_epi32(v, 0xff);
+  }
+}
+#endif
+
+/* decode block b of a list into out, which has room for 3 extra numbers */
+static void decode_block(const struct Layout *l, int b, int *out) {
+  int len = b == l->n_blocks - 1 ? l->n - b * BLOCK_LEN : BLOCK_LEN;
+  uint32_t prev = b ? block_max(l, b - 1) : 0;
+  const uint8_t *control = l->control + b * (BLOCK_LEN / 4);
+  const uint8_t *data = l->data + block_data(l, b);
+  decode_block_fn(control, data, len, prev, out);
+}
+
+void block_decode(const uint8_t *list, int *out) {
+  struct Layout l;
+  int b;
+  layout(list, &l);
+  for (b = 0; b < l.n_blocks; b++)
+    decode_block(&l, b, out + b * BLOCK_LEN);
+}
+
+/* intersect a with the list, stopping at the first common number if
+   out is NULL */
+static int intersect(const uint8_t *list, const int *a, int len, int *out) {
+  struct Layout l;
+  int block[BLOCK_LEN + 3];
+  int b, i = 0, n = 0;
+  layout(list, &l);
+  for (b = 0; b < l.n_blocks && i < len; b++) {
+    int max = block_max(&l, b), j = 0;
+    int block_len = b == l.n_blocks - 1 ? l.n - b * BLOCK_LEN : BLOCK_LEN;
+    if (max < a[i])
+      continue;
+    decode_block(&l, b, block);
+    while (i < len && j < block_len && a[i] <= max) {
+      if (a[i] < block[j]) {
+        i++;
+      } else if (a[i] > block[j]) {
+        j++;
+      } else {
+        if (!out)
+          return 1;
+        out[n++] = a[i++];
+        j++;
+      }
+    }
+  }
+  return n;
+}
+
+int block_intersects(const uint8_t *list, const int *a, int len) {
+  return intersect(list, a, len, NULL);
+}
+
+int block_intersect(const uint8_t *list, const int *a, int len, int *out) {
+  return intersect(list, a, len, out);
+}
+
+const char *block_check(const uint8_t *list, size_t size, int universe) {
+  struct Layout l;
+  int b, i;
+  uint32_t prev = 0, pos = 0;
+  if (size < 4)
+    return "truncated list";
+  layout(list, &l);
+  if (l.n < 0 || l.n >= universe)
+    return "too many followers";
+  if ((size_t)(l.data - list) > size)
+    return "truncated list";
+  for (b = 0; b < l.n_blocks; b++) {
+    int len = b == l.n_blocks - 1 ? l.n - b * BLOCK_LEN : BLOCK_LEN;
+    const uint8_t *control = l.control + b * (BLOCK_LEN / 4);
+    if (block_data(&l, b) != pos)
+      return "bad block offsets";
+    for (i = 0; i < len; i++) {
+      int n_bytes = (control[i / 4] >> 2 * (i % 4) & 3) + 1;
+      uint32_t delta = 0;
+      if ((size_t)(l.data - list) + pos + n_bytes > size)
+        return "truncated list";
+      memcpy(&delta, l.data + pos, n_bytes);
+      pos += n_bytes;
+      if (!delta || delta >= (uint32_t)universe - prev)
+        return delta ? "follower out of range" : "followers not increasing";
+      prev += delta;
+    }
+    if (block_max(&l, b) != prev || get32(l.headers + 8 * (size_t)b + 4) !=
+                                        pos)
+      return "bad block header";
+  }
+  if ((size_t)(l.data - list) + pos != size)
+    return "bad list size";
+  return NULL;
+}
@@ -0,0 +1,52 @@
+#ifndef BLOCKCODE_H
+#define BLOCKCODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Increasing lists of positive numbers in blocks of BLOCK_LEN, with the
+   differences between numbers coded in the manner of StreamVByte: 2 bits
+   per difference in a control stream give its length in bytes (1 to 4),
+   and the bytes go in a separate data stream. Four differences take one
+   control byte, which indexes a table of shuffles to decode them at once.
+
+   A list is, with numbers little-endian:
+
+     uint32_t n
+     uint32_t max, data_end     for each block: its last number, and the
+                                end of its data in the data stream
+     uint8_t control[(n + 3) / 4]
+     uint8_t data[]
+
+   The differences of a block start from the last number of the block
+   before, so a block can be decoded, or skipped by its last number,
+   without the ones before it. The decoder reads up to BLOCK_PAD bytes
+   past the end of a list. */
+
+#define BLOCK_LEN 128
+#define BLOCK_PAD 16
+
+/* The most bytes a list of n numbers can take. */
+size_t block_bound(int n);
+
+/* Code a list into out, returning its size. */
+size_t block_encode(const int *nums, int n, uint8_t *out);
+
+int block_count(const uint8_t *list);
+size_t block_size(const uint8_t *list);
+
+/* Decode a list into out, which needs room for 3 more numbers than it
+   holds. */
+void block_decode(const uint8_t *list, int *out);
+
+/* Whether the list has any of the len numbers of a, which must be
+   increasing, and their intersection. Blocks whose last number is below
+   the next number of a are skipped without decoding them. */
+int block_intersects(const uint8_t *list, const int *a, int len);
+int block_intersect(const uint8_t *list, const int *a, int len, int *out);
+
+/* The reason a list of size bytes is invalid, or NULL if it holds
+   increasing numbers in [1, universe). */
+const char *block_check(const uint8_t *list, size_t size, int universe);
+
+#endif
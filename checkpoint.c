@@ -0,0 +1,124 @@
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+
+#define CHECKPOINT_FORMAT                                                      \
+  "abbrase-checkpoint 1 length=%ld count=%ld seeded=%d seed=%llu "             \
+  "counter=%llu issued=%ld offset=%lld ranks=%lld shards=%d\n"
+#define SHARD_FORMAT "shard bytes=%lld count=%ld crc=%x\n"
+
+/* read a checkpoint. Returns 0 if there is none yet, 1 otherwise. */
+int checkpoint_read(const char *path, struct CheckpointState *st) {
+  unsigned long long seed, counter;
+  int i;
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    if (errno == ENOENT)
+      return 0;
+    err(1, "unable to open %s", path);
+  }
+  if (fscanf(f, CHECKPOINT_FORMAT, &st->length, &st->count, &st->seeded,
+             &seed, &counter, &st->issued, &st->offset, &st->n_ranks,
+             &st->n_shards) != 9 ||
+      st->n_shards < 0 || st->n_shards > MAX_SHARDS)
+    errx(9, "corrupted checkpoint file %s", path);
+  for (i = 0; i < st->n_shards; i++)
+    if (fscanf(f, SHARD_FORMAT, &st->shards[i].bytes, &st->shards[i].count,
+               &st->shards[i].crc) != 3)
+      errx(9, "corrupted checkpoint file %s", path);
+  st->seed = seed;
+  st->counter = counter;
+  fclose(f);
+  return 1;
+}
+
+static void checkpoint_write(struct Checkpointer *c,
+                             const struct CheckpointState *st) {
+  int i;
+  /* the data a checkpoint refers to must be on disk before it is */
+  for (i = 0; i < c->n_fds; i++)
+    if (fdatasync(c->fds[i]) && errno != EINVAL)
+      err(9, "unable to sync output");
+
+  size_t len = strlen(c->path) + 5;
+  char tmp[len];
+  snprintf(tmp, len, "%s.tmp", c->path);
+  FILE *f = fopen(tmp, "w");
+  if (!f)
+    err(9, "unable to write %s", tmp);
+  fprintf(f, CHECKPOINT_FORMAT, st->length, st->count, st->seeded,
+          (unsigned long long)st->seed, (unsigned long long)st->counter,
+          st->issued, st->offset, st->n_ranks, st->n_shards);
+  for (i = 0; i < st->n_shards; i++)
+    fprintf(f, SHARD_FORMAT, st->shards[i].bytes, st->shards[i].count,
+            st->shards[i].crc);
+  if (fflush(f) || fsync(fileno(f)) || fclose(f))
+    err(9, "unable to write %s", tmp);
+  if (rename(tmp, c->path))
+    err(9, "unable to replace %s", c->path);
+}
+
+static void *checkpointer_thread(void *arg) {
+  struct Checkpointer *c = arg;
+  struct CheckpointState st;
+  pthread_mutex_lock(&c->lock);
+  for (;;) {
+    while (!c->pending && !c->stopping)
+      pthread_cond_wait(&c->cond, &c->lock);
+    if (!c->pending)
+      break;
+    st = c->state;
+    c->pending = 0;
+    pthread_mutex_unlock(&c->lock);
+    checkpoint_write(c, &st);
+    pthread_mutex_lock(&c->lock);
+  }
+  pthread_mutex_unlock(&c->lock);
+  return NULL;
+}
+
+struct Checkpointer *checkpointer_start(const char *path, const int *fds,
+                                        int n_fds) {
+  struct Checkpointer *c = malloc(sizeof *c);
+  c->path = strdup(path);
+  c->n_fds = n_fds;
+  memcpy(c->fds, fds, sizeof(int) * n_fds);
+  c->pending = 0;
+  c->stopping = 0;
+  pthread_mutex_init(&c->lock, NULL);
+  pthread_cond_init(&c->cond, NULL);
+  if (pthread_create(&c->thread, NULL, checkpointer_thread, c))
+    errx(7, "unable to start checkpoint thread");
+  return c;
+}
+
+/* queue a checkpoint. If the previous one is still pending, it is
+   replaced. */
+void checkpointer_post(struct Checkpointer *c,
+                       const struct CheckpointState *st) {
+  pthread_mutex_lock(&c->lock);
+  c->state = *st;
+  c->pending = 1;
+  pthread_cond_signal(&c->cond);
+  pthread_mutex_unlock(&c->lock);
+}
+
+/* wait for the pending checkpoint to be written and stop the thread */
+void checkpointer_finish(struct Checkpointer *c) {
+  pthread_mutex_lock(&c->lock);
+  c->stopping = 1;
+  pthread_cond_signal(&c->cond);
+  pthread_mutex_unlock(&c->lock);
+  pthread_join(c->thread, NULL);
+  pthread_mutex_destroy(&c->lock);
+  pthread_cond_destroy(&c->cond);
+  free(c->path);
+  free(c);
+}
@@ -0,0 +1,44 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "writer.h"
+
+/* everything needed to resume a bulk generation run */
+struct CheckpointState {
+  long length;
+  long count;
+  int seeded;
+  uint64_t seed;
+  uint64_t counter;  /* random prefixes drawn so far */
+  long issued;       /* passwords written so far */
+  long long offset;  /* bytes of output written so far */
+  long long n_ranks; /* ranks in the dedup snapshot */
+  int n_shards;      /* 0 unless the output is sharded */
+  struct ShardState shards[MAX_SHARDS];
+};
+
+/* checkpoints are written by a background thread, so generation only
+   stalls long enough to hand over the latest state */
+struct Checkpointer {
+  char *path;
+  int n_fds; /* files to sync before each checkpoint */
+  int fds[MAX_SHARDS + 1];
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  struct CheckpointState state;
+  int pending;
+  int stopping;
+};
+
+int checkpoint_read(const char *path, struct CheckpointState *st);
+struct Checkpointer *checkpointer_start(const char *path, const int *fds,
+                                        int n_fds);
+void checkpointer_post(struct Checkpointer *c,
+                       const struct CheckpointState *st);
+void checkpointer_finish(struct Checkpointer *c);
+
+#endif
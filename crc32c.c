@@ -0,0 +1,51 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "crc32c.h"
+
+#define POLY 0x82f63b78 /* reversed Castagnoli polynomial */
+
+static uint32_t table[256];
+
+/* fill the table before main, so threads never race to build it */
+__attribute__((constructor)) static void crc32c_init_table() {
+  uint32_t i, j, crc;
+  for (i = 0; i < 256; i++) {
+    crc = i;
+    for (j = 0; j < 8; j++)
+      crc = crc & 1 ? (crc >> 1) ^ POLY : crc >> 1;
+    table[i] = crc;
+  }
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t len) {
+  while (len--)
+    crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_hw(uint32_t crc, const unsigned char *p, size_t len) {
+  uint64_t crc64 = crc, word;
+  while (len >= 8) {
+    memcpy(&word, p, 8);
+    crc64 = __builtin_ia32_crc32di(crc64, word);
+    p += 8;
+    len -= 8;
+  }
+  crc = crc64;
+  while (len--)
+    crc = __builtin_ia32_crc32qi(crc, *p++);
+  return crc;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+  crc = ~crc;
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("sse4.2"))
+    return ~crc32c_hw(crc, data, len);
+#endif
+  return ~crc32c_sw(crc, data, len);
+}
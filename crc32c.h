@@ -0,0 +1,12 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* CRC-32C (Castagnoli), using the SSE 4.2 instruction when available.
+   Start with crc = 0, and pass the previous result to continue a
+   checksum over more data. */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+#endif
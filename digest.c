@@ -0,0 +1,992 @@
+/* build wordlist_bigrams.txt from data/prefixes.txt, data/1gram_common.csv
+and data/2gram.csv.gz. the output is identical to that of digest.py.
+
+the 2-gram file is inflated in large blocks, which are split at line
+boundaries and parsed on one thread each. word pairs are collected as 64-bit
+keys and radix sorted, which leaves each follower list sorted and makes
+duplicates adjacent.
+
+with -e STORE, the pairs are read from an edge store instead (see
+edgestore.h), which holds every pair of the 2-gram file. the store is built
+first if it's missing or older than the 2-gram file, so changing the
+vocabulary only costs a pass over the store.
+
+with -b OUT.bin, the graph is also written in the binary format of
+wordgraph.h with block coded follower lists (see blockcode.h), checked so
+abbrase --graph can load it without checking it again. */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "blockcode.h"
+#include "edgestore.h"
+#include "progress.h"
+#include "wordgraph.h"
+
+#define BLOCK_SIZE (8 << 20)
+#define RADIX_BITS 12
+#define BISECT_ITERATIONS 20
+#define BISECT_MIN_WORDS 64
+
+/* a set of lowercase words, numbered from 1 in insertion order */
+struct Words {
+    char *keys;
+    size_t keys_len, keys_cap;
+    size_t *offs, *lens;
+    int n, cap, max_len;
+    int *table;     /* word number, or 0 for an empty slot */
+    size_t mask;
+};
+
+static uint64_t hash_word(const char *s, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    while (len--)
+        h = (h ^ (unsigned char)*s++) * 0x100000001b3ULL;
+    return h ^ (h >> 29);
+}
+
+static int words_find(const struct Words *w, const char *s, size_t len) {
+    size_t slot;
+    int id;
+    if (!w->table || (int)len > w->max_len)
+        return 0;
+    for (slot = hash_word(s, len) & w->mask; (id = w->table[slot]);
+         slot = (slot + 1) & w->mask)
+        if (w->lens[id] == len && !memcmp(w->keys + w->offs[id], s, len))
+            return id;
+    return 0;
+}
+
+static void words_rehash(struct Words *w, size_t n_slots) {
+    int id;
+    free(w->table);
+    w->table = calloc(n_slots, sizeof(*w->table));
+    w->mask = n_slots - 1;
+    for (id = 1; id <= w->n; id++) {
+        size_t slot = hash_word(w->keys + w->offs[id], w->lens[id]) & w->mask;
+        while (w->table[slot])
+            slot = (slot + 1) & w->mask;
+        w->table[slot] = id;
+    }
+}
+
+/* add a word that isn't in the set yet, returning its number */
+static int words_add(struct Words *w, const char *s, size_t len) {
+    if (w->n + 1 >= w->cap) {
+        w->cap = w->cap ? w->cap * 2 : 1024;
+        w->offs = realloc(w->offs, w->cap * sizeof(*w->offs));
+        w->lens = realloc(w->lens, w->cap * sizeof(*w->lens));
+    }
+    if (w->keys_len + len > w->keys_cap) {
+        w->keys_cap = (w->keys_len + len) * 2;
+        w->keys = realloc(w->keys, w->keys_cap);
+    }
+    memcpy(w->keys + w->keys_len, s, len);
+    w->n++;
+    w->offs[w->n] = w->keys_len;
+    w->lens[w->n] = len;
+    w->keys_len += len;
+    if ((int)len > w->max_len)
+        w->max_len = len;
+    /* keep the table at most a quarter full, so probes stay short */
+    if (!w->table || (size_t)w->n * 4 > w->mask + 1)
+        words_rehash(w, w->table ? (w->mask + 1) * 2 : 4096);
+    else {
+        size_t slot = hash_word(s, len) & w->mask;
+        while (w->table[slot])
+            slot = (slot + 1) & w->mask;
+        w->table[slot] = w->n;
+    }
+    return w->n;
+}
+
+/* python's str.split() separators */
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+           c == '\f';
+}
+
+static void lower(char *s, size_t len) {
+    while (len--) {
+        if (*s >= 'A' && *s <= 'Z')
+            *s += 'a' - 'A';
+        s++;
+    }
+}
+
+/* find the first whitespace-separated token of a line */
+static size_t first_token(char *line, char **token) {
+    size_t len = 0;
+    while (is_space(*line))
+        line++;
+    *token = line;
+    while (line[len] && !is_space(line[len]))
+        len++;
+    return len;
+}
+
+static FILE *open_file(const char *path, const char *mode) {
+    FILE *f = fopen(path, mode);
+    if (!f)
+        err(2, "unable to open %s", path);
+    return f;
+}
+
+/* writes to the output are counted as the stage's progress */
+static ssize_t counted_write(void *fd, const char *buf, size_t len) {
+    ssize_t n = progress_write((int)(intptr_t)fd, buf, len);
+    return n < 0 ? 0 : n;
+}
+
+static int counted_close(void *fd) {
+    return close((int)(intptr_t)fd);
+}
+
+static FILE *create_output(const char *path) {
+    cookie_io_functions_t io = {NULL, counted_write, NULL, counted_close};
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    FILE *f;
+    if (fd < 0 || !(f = fopencookie((void *)(intptr_t)fd, "w", io)))
+        err(2, "unable to create %s", path);
+    setvbuf(f, NULL, _IOFBF, 1 << 20);
+    return f;
+}
+
+static void read_prefixes(const char *path, struct Words *prefixes) {
+    FILE *f = open_file(path, "r");
+    char *line = NULL, *token;
+    size_t cap = 0, len;
+    while (getline(&line, &cap, f) > 0) {
+        len = first_token(line, &token);
+        if (!words_find(prefixes, token, len))
+            words_add(prefixes, token, len);
+    }
+    free(line);
+    fclose(f);
+}
+
+/* number the common words whose prefix is a chosen one. spellings gets the
+words as written, one per line, and word_prefix each word's prefix number. */
+static void build_common(const char *path, const struct Words *prefixes,
+                         struct Words *common, int **word_prefix,
+                         char **spellings, size_t *spellings_len) {
+    FILE *f = open_file(path, "r");
+    char *line = NULL, *token, *key = NULL;
+    size_t cap = 0, key_cap = 0, len;
+    FILE *words_out = open_memstream(spellings, spellings_len);
+    int prefix, n_prefix = 0;
+
+    while (getline(&line, &cap, f) > 0) {
+        len = first_token(line, &token);
+        if (len > key_cap)
+            key = realloc(key, key_cap = len * 2);
+        memcpy(key, token, len);
+        lower(key, len);
+        if (words_find(common, key, len) ||
+            !(prefix = words_find(prefixes, key, len < 3 ? len : 3)))
+            continue;
+        fwrite(token, 1, len, words_out);
+        fputc('\n', words_out);
+        words_add(common, key, len);
+        if (common->n >= n_prefix) {
+            n_prefix = common->cap;
+            *word_prefix = realloc(*word_prefix, n_prefix * sizeof(int));
+        }
+        (*word_prefix)[common->n] = prefix;
+    }
+    fclose(words_out);
+    printf("words: %d\n", common->n + 1);
+    free(key);
+    free(line);
+    fclose(f);
+}
+
+/* the word pairs found by one parsing thread. when building an edge store,
+vocab collects every word and counts the count of each pair. */
+struct Parser {
+    const struct Words *common, *prefixes;
+    const int *word_prefix;
+    int word_bits;
+    struct Words *vocab;
+    char *key_a, *key_b;    /* for lowercasing */
+    size_t key_cap;
+    const char *start, *end;
+    uint64_t *pairs, *counts;
+    size_t n_pairs, cap;
+    unsigned char *transitions;     /* bitmap of attested prefix pairs */
+};
+
+static void add_pair(struct Parser *p, uint64_t key, long long count) {
+    if (p->n_pairs == p->cap) {
+        p->cap = p->cap ? p->cap * 2 : 1 << 16;
+        p->pairs = realloc(p->pairs, p->cap * sizeof(*p->pairs));
+        if (p->vocab)
+            p->counts = realloc(p->counts, p->cap * sizeof(*p->counts));
+        if (!p->pairs || (p->vocab && !p->counts))
+            err(2, "unable to allocate word pairs");
+    }
+    if (p->vocab)
+        p->counts[p->n_pairs] = count;
+    p->pairs[p->n_pairs++] = key;
+}
+
+/* record a pair of common words */
+static void add_common_pair(struct Parser *p, int id_a, int id_b) {
+    size_t t = (size_t)(p->word_prefix[id_a] - 1) * p->prefixes->n +
+               p->word_prefix[id_b] - 1;
+    p->transitions[t / 8] |= 1 << t % 8;
+    add_pair(p, (uint64_t)id_a << p->word_bits | id_b, 0);
+}
+
+static int intern(struct Words *w, const char *s, size_t len) {
+    int id = words_find(w, s, len);
+    return id ? id : words_add(w, s, len);
+}
+
+static long long parse_count(const char *p, const char *end) {
+    long long v = 0;
+    int neg = 0;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+    while (p < end && (unsigned)(*p - '0') < 10)
+        v = v * 10 + (*p++ - '0');
+    return neg ? -v : v;
+}
+
+static void parse_line(struct Parser *p, const char *line, const char *end) {
+    const char *tokens[4];
+    size_t lens[4];
+    int n = 0, id_a, id_b;
+
+    while (line < end) {
+        while (line < end && is_space(*line))
+            line++;
+        if (line == end)
+            break;
+        if (n == 4)
+            return;
+        tokens[n] = line;
+        while (line < end && !is_space(*line))
+            line++;
+        lens[n] = line - tokens[n];
+        n++;
+    }
+    if (n != 3)
+        return;
+    if (p->vocab) {
+        if (lens[0] > p->key_cap || lens[1] > p->key_cap) {
+            p->key_cap = 2 * (lens[0] > lens[1] ? lens[0] : lens[1]);
+            p->key_a = realloc(p->key_a, p->key_cap);
+            p->key_b = realloc(p->key_b, p->key_cap);
+        }
+    } else if (lens[0] > p->key_cap || lens[1] > p->key_cap) {
+        return;     /* longer than any common word */
+    }
+
+    memcpy(p->key_a, tokens[0], lens[0]);
+    lower(p->key_a, lens[0]);
+    memcpy(p->key_b, tokens[1], lens[1]);
+    lower(p->key_b, lens[1]);
+    if (p->vocab) {
+        id_a = intern(p->vocab, p->key_a, lens[0]);
+        id_b = intern(p->vocab, p->key_b, lens[1]);
+        add_pair(p, (uint64_t)id_a << 32 | id_b,
+                 parse_count(tokens[2], tokens[2] + lens[2]));
+    } else if ((id_a = words_find(p->common, p->key_a, lens[0])) &&
+               (id_b = words_find(p->common, p->key_b, lens[1]))) {
+        add_common_pair(p, id_a, id_b);
+    }
+}
+
+static void *parse_block(void *arg) {
+    struct Parser *p = arg;
+    const char *line = p->start, *nl;
+    size_t lines;
+    for (lines = 0; line < p->end; lines++) {
+        if (!(nl = memchr(line, '\n', p->end - line)))
+            nl = p->end;
+        parse_line(p, line, nl);
+        line = nl + 1;
+    }
+    progress_input(0, lines, 0);
+    return NULL;
+}
+
+/* parse the 2-gram file on n_threads threads. each round inflates up to
+n_threads blocks into buf, then parses them in parallel. */
+static void build_edges(const char *path, struct Parser *parsers,
+                        int n_threads) {
+    gzFile gz = gzopen(path, "rb");
+    size_t cap = (size_t)BLOCK_SIZE * n_threads, len = 0;
+    char *buf = malloc(cap);
+    pthread_t *threads = malloc(n_threads * sizeof(*threads));
+    int i, eof = 0;
+
+    if (!gz)
+        err(2, "unable to open %s", path);
+    gzbuffer(gz, 1 << 20);
+    while (!eof) {
+        while (len < cap) {
+            double start = progress_now();
+            int n = gzread(gz, buf + len, cap - len > INT_MAX ? INT_MAX
+                                                                : cap - len);
+            progress_input(n > 0 ? n : 0, 0, progress_now() - start);
+            if (n < 0) {
+                int errnum;
+                errx(2, "%s: %s", path, gzerror(gz, &errnum));
+            }
+            if (n == 0) {
+                eof = 1;
+                break;
+            }
+            len += n;
+        }
+
+        /* split at the last newline, keeping the partial line for later */
+        char *end = buf + len;
+        if (!eof) {
+            end = memrchr(buf, '\n', len);
+            if (!end) {
+                buf = realloc(buf, cap *= 2);
+                continue;
+            }
+            end++;
+        }
+        const char *start = buf;
+        for (i = 0; i < n_threads; i++) {
+            const char *stop = start + (end - start) / (n_threads - i), *nl;
+            if (i == n_threads - 1 || !(nl = memchr(stop, '\n', end - stop)))
+                stop = end;
+            else
+                stop = nl + 1;
+            parsers[i].start = start;
+            parsers[i].end = stop;
+            start = stop;
+            if (pthread_create(&threads[i], NULL, parse_block, &parsers[i]))
+                errx(2, "unable to create thread");
+        }
+        for (i = 0; i < n_threads; i++)
+            pthread_join(threads[i], NULL);
+
+        len = buf + len - end;
+        memmove(buf, end, len);
+    }
+    gzclose(gz);
+    free(threads);
+    free(buf);
+}
+
+/* LSD radix sort of keys with the given number of significant bits, moving
+values (if any) along with them */
+static void radix_sort(uint64_t *keys, uint64_t *values, size_t n, int bits) {
+    uint64_t *tmp = malloc(n * sizeof(*tmp)), *src = keys, *dst = tmp, *t;
+    uint64_t *tmp_values = NULL, *src_v = values, *dst_v = NULL;
+    size_t counts[1 << RADIX_BITS], i;
+    int shift;
+    if (values && !(dst_v = tmp_values = malloc(n * sizeof(*tmp_values))))
+        tmp = NULL;
+    if (!tmp)
+        err(2, "unable to allocate sort buffer");
+    for (shift = 0; shift < bits; shift += RADIX_BITS) {
+        size_t sum = 0;
+        memset(counts, 0, sizeof(counts));
+        for (i = 0; i < n; i++)
+            counts[src[i] >> shift & ((1 << RADIX_BITS) - 1)]++;
+        for (i = 0; i < 1 << RADIX_BITS; i++) {
+            size_t c = counts[i];
+            counts[i] = sum;
+            sum += c;
+        }
+        for (i = 0; i < n; i++) {
+            size_t j = counts[src[i] >> shift & ((1 << RADIX_BITS) - 1)]++;
+            dst[j] = src[i];
+            if (values)
+                dst_v[j] = src_v[i];
+        }
+        t = src;
+        src = dst;
+        dst = t;
+        t = src_v;
+        src_v = dst_v;
+        dst_v = t;
+    }
+    if (src != keys) {
+        memcpy(keys, src, n * sizeof(*keys));
+        if (values)
+            memcpy(values, src_v, n * sizeof(*values));
+    }
+    free(tmp);
+    free(tmp_values);
+}
+
+/* write the follower lists in the encoding of digest.py: deltas minus one as
+printable base-32 varints, with runs of zeros as single characters */
+static size_t encode_zero_run(char *out, int zero_run) {
+    size_t len = 0;
+    while (zero_run > 0) {
+        out[len++] = 0x60 + (zero_run < 0x1f ? zero_run : 0x1f) - 1;
+        zero_run -= 0x1f;
+    }
+    return len;
+}
+
+static size_t write_followers(FILE *out, const uint64_t *pairs,
+                              size_t n_pairs, int n_words, int word_bits) {
+    uint64_t mask = ((uint64_t)1 << word_bits) - 1;
+    /* the longest zero run, a varint and the newline fit in this much */
+    size_t i = 0, cap = 2 * (n_words / 0x1f + 1 + 8 + 1), len = 0, total = 0;
+    char *line = malloc(cap);
+    int word;
+
+    for (word = 0; word < n_words; word++) {
+        int last = 0, zero_run = 0;
+        for (;; i++) {
+            int end = i == n_pairs || (int)(pairs[i] >> word_bits) != word;
+            unsigned delta = 0;
+            if (!end) {
+                int num = pairs[i] & mask;
+                if (num == last)
+                    continue;   /* duplicate */
+                delta = num - last - 1;
+                last = num;
+                if (!delta) {
+                    zero_run++;
+                    continue;
+                }
+            }
+            if (len > cap / 2) {
+                if (out)
+                    fwrite(line, 1, len, out);
+                total += len;
+                len = 0;
+            }
+            len += encode_zero_run(line + len, zero_run);
+            zero_run = 0;
+            if (end)
+                break;
+            do {
+                line[len++] = (delta < 0x20 ? 0x40 : 0x20) | (delta & 0x1f);
+                delta >>= 5;
+            } while (delta);
+        }
+        line[len++] = '\n';
+    }
+    if (out)
+        fwrite(line, 1, len, out);
+    total += len;
+    free(line);
+    return total;
+}
+
+/* more sources first, then by number */
+static int in_degree_cmp(const void *a, const void *b, void *arg) {
+    const size_t *in_offs = arg;
+    int x = *(const int *)a, y = *(const int *)b;
+    size_t dx = in_offs[x + 1] - in_offs[x], dy = in_offs[y + 1] - in_offs[y];
+    if (dx != dy)
+        return dx < dy ? 1 : -1;
+    return x - y;
+}
+
+/* larger gain first, then by number */
+static int gain_cmp(const void *a, const void *b, void *arg) {
+    const double *gain = arg;
+    int x = *(const int *)a, y = *(const int *)b;
+    if (gain[x] != gain[y])
+        return gain[x] < gain[y] ? 1 : -1;
+    return x - y;
+}
+
+/* the cost of a source with d of its followers among n words, in bits of
+gaps when they are spread evenly */
+static void fill_costs(double *costs, int n) {
+    int d;
+    for (d = 0; d <= n + 1; d++)
+        costs[d] = d * log2(n / (d + 1.0));
+}
+
+/* one level of recursive graph bisection: split words[lo, hi) into halves,
+repeatedly swapping the words whose move most reduces the cost of the
+sources' follower lists */
+static void bisect(int *words, int lo, int hi, const size_t *in_offs,
+                   const int *in_adj, int *side, int *left, int *right,
+                   double *gain, double *costs_l, double *costs_r) {
+    int mid = lo + (hi - lo) / 2, i, iter;
+    size_t k;
+    fill_costs(costs_l, mid - lo);
+    fill_costs(costs_r, hi - mid);
+    for (iter = 0; iter < BISECT_ITERATIONS; iter++) {
+        for (i = lo; i < hi; i++) {
+            side[words[i]] = i < mid;
+            for (k = in_offs[words[i]]; k < in_offs[words[i] + 1]; k++)
+                left[in_adj[k]] = right[in_adj[k]] = 0;
+        }
+        for (i = lo; i < hi; i++)
+            for (k = in_offs[words[i]]; k < in_offs[words[i] + 1]; k++) {
+                if (side[words[i]])
+                    left[in_adj[k]]++;
+                else
+                    right[in_adj[k]]++;
+            }
+        for (i = lo; i < hi; i++) {
+            int w = words[i];
+            double g = 0;
+            for (k = in_offs[w]; k < in_offs[w + 1]; k++) {
+                int l = left[in_adj[k]], r = right[in_adj[k]];
+                if (side[w])
+                    g += costs_l[l] + costs_r[r] - costs_l[l - 1] -
+                         costs_r[r + 1];
+                else
+                    g += costs_l[l] + costs_r[r] - costs_l[l + 1] -
+                         costs_r[r - 1];
+            }
+            gain[w] = g;
+        }
+        qsort_r(words + lo, mid - lo, sizeof(*words), gain_cmp, gain);
+        qsort_r(words + mid, hi - mid, sizeof(*words), gain_cmp, gain);
+        int swapped = 0;
+        for (i = 0; lo + i < mid && mid + i < hi; i++) {
+            int a = words[lo + i], b = words[mid + i];
+            if (gain[a] + gain[b] <= 0)
+                break;
+            words[lo + i] = b;
+            words[mid + i] = a;
+            swapped = 1;
+        }
+        if (!swapped)
+            break;
+    }
+    if (mid - lo >= BISECT_MIN_WORDS) {
+        bisect(words, lo, mid, in_offs, in_adj, side, left, right, gain,
+               costs_l, costs_r);
+        bisect(words, mid, hi, in_offs, in_adj, side, left, right, gain,
+               costs_l, costs_r);
+    }
+}
+
+/* renumber the words by recursive graph bisection, which puts words that
+follow the same words next to each other, so follower lists have smaller
+gaps. it starts from the order of how many words each word follows. word 0
+stays 0. pairs must be sorted and unique. returns the new number of each
+word. */
+static int *reorder_words(const uint64_t *pairs, size_t n_pairs, int n_words,
+                          int word_bits) {
+    uint64_t mask = ((uint64_t)1 << word_bits) - 1;
+    size_t *in_offs = calloc(n_words + 1, sizeof(*in_offs)), *fill, i;
+    int *in_adj = malloc((n_pairs + 1) * sizeof(*in_adj));
+    int *new_number = calloc(n_words, sizeof(*new_number));
+    int *words = malloc(n_words * sizeof(*words)), word;
+
+    /* the sources of each word */
+    for (i = 0; i < n_pairs; i++)
+        in_offs[(pairs[i] & mask) + 1]++;
+    for (word = 0; word < n_words; word++)
+        in_offs[word + 1] += in_offs[word];
+    fill = malloc(n_words * sizeof(*fill));
+    memcpy(fill, in_offs, n_words * sizeof(*fill));
+    for (i = 0; i < n_pairs; i++)
+        in_adj[fill[pairs[i] & mask]++] = pairs[i] >> word_bits;
+
+    for (word = 1; word < n_words; word++)
+        words[word - 1] = word;
+    qsort_r(words, n_words - 1, sizeof(*words), in_degree_cmp, in_offs);
+
+    int *side = malloc(n_words * sizeof(*side));
+    int *left = malloc(n_words * sizeof(*left));
+    int *right = malloc(n_words * sizeof(*right));
+    double *gain = malloc(n_words * sizeof(*gain));
+    double *costs_l = malloc((n_words + 2) * sizeof(*costs_l));
+    double *costs_r = malloc((n_words + 2) * sizeof(*costs_r));
+    if (n_words - 1 >= BISECT_MIN_WORDS)
+        bisect(words, 0, n_words - 1, in_offs, in_adj, side, left, right, gain,
+               costs_l, costs_r);
+    for (i = 0; i < (size_t)n_words - 1; i++)
+        new_number[words[i]] = i + 1;
+
+    free(side);
+    free(left);
+    free(right);
+    free(gain);
+    free(costs_l);
+    free(costs_r);
+    free(in_offs);
+    free(fill);
+    free(in_adj);
+    free(words);
+    return new_number;
+}
+
+/* renumber both words of each pair and sort the pairs again */
+static void renumber_pairs(uint64_t *pairs, size_t n_pairs,
+                           const int *new_number, int word_bits) {
+    uint64_t mask = ((uint64_t)1 << word_bits) - 1;
+    size_t i;
+    for (i = 0; i < n_pairs; i++)
+        pairs[i] = (uint64_t)new_number[pairs[i] >> word_bits] << word_bits |
+                   new_number[pairs[i] & mask];
+    radix_sort(pairs, NULL, n_pairs, 2 * word_bits);
+}
+
+/* write the original number of each word as printable base-32 varints */
+static void write_ranks(FILE *out, const int *new_number, int n_words) {
+    int *rank = malloc(n_words * sizeof(*rank)), word;
+    for (word = 1; word < n_words; word++)
+        rank[new_number[word]] = word;
+    fputs("#ranks\n", out);
+    for (word = 1; word < n_words; word++) {
+        unsigned r = rank[word];
+        do {
+            fputc((r < 0x20 ? 0x40 : 0x20) | (r & 0x1f), out);
+            r >>= 5;
+        } while (r);
+    }
+    fputc('\n', out);
+    free(rank);
+}
+
+/* write the graph in the binary format with block coded follower lists.
+the words are in spellings one per line, renumbered by new_number if it
+isn't NULL, and the pairs are sorted but may have duplicates. */
+static void write_blocked(const char *path, const char *spellings,
+                          const int *new_number, const uint64_t *pairs,
+                          size_t n_pairs, int n_words, int word_bits,
+                          int n_threads) {
+    struct WordGraph *g = calloc(1, sizeof(*g));
+    uint64_t mask = ((uint64_t)1 << word_bits) - 1;
+    int *list = malloc(n_words * sizeof(*list)), word;
+    size_t i = 0, len = 0, cap = 1 << 20;
+    size_t *offs = malloc((n_words + 1) * sizeof(*offs));
+    uint8_t *data = malloc(cap);
+    const char *line = spellings;
+
+    g->n_words = n_words;
+    g->words = calloc(n_words, sizeof(*g->words));
+    for (word = 1; word < n_words; word++) {
+        const char *end = strchr(line, '\n');
+        g->words[new_number ? new_number[word] : word] =
+            strndup(line, end - line);
+        line = end + 1;
+    }
+    for (word = 0; word < n_words; word++) {
+        int n = 0;
+        for (; i < n_pairs && (int)(pairs[i] >> word_bits) == word; i++)
+            if (!n || list[n - 1] != (int)(pairs[i] & mask))
+                list[n++] = pairs[i] & mask;
+        while (len + block_bound(n) + BLOCK_PAD > cap)
+            data = realloc(data, cap *= 2);
+        offs[word] = len;
+        len += block_encode(list, n, data + len);
+    }
+    offs[n_words] = len;
+    memset(data + len, 0, BLOCK_PAD);
+    /* the lists are back to back, with a pointer to the end after them */
+    g->blocks = malloc((n_words + 1) * sizeof(*g->blocks));
+    for (word = 0; word <= n_words; word++)
+        g->blocks[word] = data + offs[word];
+    if (new_number) {
+        g->rank = calloc(n_words, sizeof(*g->rank));
+        for (word = 1; word < n_words; word++)
+            g->rank[new_number[word]] = word;
+    }
+    if (wordgraph_validate(g, n_threads) >= 0)
+        errx(3, "the block coded graph is invalid");
+    wordgraph_write_binary(g, path, 1);
+
+    for (word = 1; word < n_words; word++)
+        free(g->words[word]);
+    free(g->words);
+    free(g->blocks);
+    free(g->rank);
+    free(g);
+    free(data);
+    free(offs);
+    free(list);
+}
+
+static int word_order(const void *a, const void *b, void *arg) {
+    const struct Words *w = arg;
+    int x = *(const int *)a, y = *(const int *)b;
+    size_t x_len = w->lens[x], y_len = w->lens[y];
+    int c = memcmp(w->keys + w->offs[x], w->keys + w->offs[y],
+                   x_len < y_len ? x_len : y_len);
+    if (c)
+        return c;
+    return x_len < y_len ? -1 : x_len > y_len;
+}
+
+/* build an edge store from the 2-gram file. each thread interns words in
+its own table, then the words are merged, numbered in byte order, and the
+pairs renumbered, sorted and summed. */
+static void build_store(const char *corpus, const char *path, int n_threads) {
+    struct Parser *parsers = calloc(n_threads, sizeof(*parsers));
+    struct Words words = {0};
+    int **remap = malloc(n_threads * sizeof(*remap));
+    int i, id, word_bits;
+    size_t j, n_pairs = 0;
+
+    for (i = 0; i < n_threads; i++)
+        parsers[i].vocab = calloc(1, sizeof(struct Words));
+    build_edges(corpus, parsers, n_threads);
+
+    for (i = 0; i < n_threads; i++) {
+        struct Words *vocab = parsers[i].vocab;
+        remap[i] = malloc((vocab->n + 1) * sizeof(**remap));
+        for (id = 1; id <= vocab->n; id++)
+            remap[i][id] = intern(&words, vocab->keys + vocab->offs[id],
+                                  vocab->lens[id]);
+        n_pairs += parsers[i].n_pairs;
+    }
+
+    /* number the words from 0 in byte order */
+    int *order = malloc((words.n + 1) * sizeof(*order));
+    int *rank = malloc((words.n + 1) * sizeof(*rank));
+    uint64_t *word_offs = malloc((words.n + 1) * sizeof(*word_offs));
+    char *word_bytes = malloc(words.keys_len + 1);
+    for (id = 0; id < words.n; id++)
+        order[id] = id + 1;
+    qsort_r(order, words.n, sizeof(*order), word_order, &words);
+    word_offs[0] = 0;
+    for (id = 0; id < words.n; id++) {
+        rank[order[id]] = id;
+        memcpy(word_bytes + word_offs[id], words.keys + words.offs[order[id]],
+               words.lens[order[id]]);
+        word_offs[id + 1] = word_offs[id] + words.lens[order[id]];
+    }
+    for (word_bits = 1; (1 << word_bits) < words.n; word_bits++)
+        ;
+
+    uint64_t *keys = malloc((n_pairs ? n_pairs : 1) * sizeof(*keys));
+    uint64_t *counts = malloc((n_pairs ? n_pairs : 1) * sizeof(*counts));
+    if (!keys || !counts)
+        err(2, "unable to allocate word pairs");
+    n_pairs = 0;
+    for (i = 0; i < n_threads; i++) {
+        for (j = 0; j < parsers[i].n_pairs; j++) {
+            uint64_t pair = parsers[i].pairs[j];
+            keys[n_pairs] = (uint64_t)rank[remap[i][pair >> 32]] << word_bits |
+                            rank[remap[i][pair & 0xffffffff]];
+            counts[n_pairs++] = parsers[i].counts[j];
+        }
+        free(parsers[i].pairs);
+        free(parsers[i].counts);
+        free(remap[i]);
+    }
+    radix_sort(keys, counts, n_pairs, 2 * word_bits);
+
+    /* sum the counts of repeated pairs */
+    size_t n_unique = 0;
+    for (j = 0; j < n_pairs; j++) {
+        if (n_unique && keys[n_unique - 1] == keys[j]) {
+            counts[n_unique - 1] += counts[j];
+        } else {
+            keys[n_unique] = keys[j];
+            counts[n_unique++] = counts[j];
+        }
+    }
+    edge_store_write(path, words.n, word_offs, word_bytes, n_unique, keys,
+                     counts, word_bits);
+    printf("edge store: %d words, %zu pairs\n", words.n, n_unique);
+}
+
+/* find the pairs of common words in an edge store */
+static void store_pairs(const char *path, struct Parser *p) {
+    struct EdgeStore store;
+    int id;
+    uint64_t i;
+
+    edge_store_open(&store, path);
+    int *to_common = calloc(store.n_words ? store.n_words : 1, sizeof(int));
+    int64_t *numbers = malloc((p->common->n + 1) * sizeof(*numbers));
+    for (id = 1; id <= p->common->n; id++) {
+        numbers[id] = edge_store_find(&store, p->common->keys +
+                                      p->common->offs[id], p->common->lens[id]);
+        if (numbers[id] >= 0)
+            to_common[numbers[id]] = id;
+    }
+    for (id = 1; id <= p->common->n; id++) {
+        if (numbers[id] < 0)
+            continue;
+        for (i = store.rows[numbers[id]]; i < store.rows[numbers[id] + 1]; i++)
+            if (to_common[store.followers[i]])
+                add_common_pair(p, id, to_common[store.followers[i]]);
+    }
+    free(numbers);
+    free(to_common);
+    edge_store_close(&store);
+}
+
+/* whether the edge store needs to be built from the 2-gram file */
+static int store_stale(const char *path, const char *corpus) {
+    struct stat store_st, corpus_st;
+    if (stat(path, &store_st))
+        return 1;
+    return !stat(corpus, &corpus_st) &&
+           corpus_st.st_mtime > store_st.st_mtime;
+}
+
+static void usage(const char *name) {
+    errx(1, "usage: %s [-j N] [-e STORE] [-r] [-b OUT.bin] [PREFIXES "
+         "COMMON_1GRAMS 2GRAMS OUTPUT]\n"
+         "  -j N       parse on N threads (default: one per CPU)\n"
+         "  -e STORE   read word pairs from an edge store, building it from\n"
+         "             2GRAMS first if it is missing or older\n"
+         "  -r         renumber words for smaller follower lists, recording\n"
+         "             the frequency order in a rank section, unless that\n"
+         "             doesn't make them smaller\n"
+         "  -b OUT.bin also write the graph in the binary format, with\n"
+         "             block coded follower lists\n"
+         "the files default to data/prefixes.txt, data/1gram_common.csv,\n"
+         "data/2gram.csv.gz and wordlist_bigrams.txt.", name);
+}
+
+int main(int argc, char *argv[]) {
+    const char *paths[4] = {"data/prefixes.txt", "data/1gram_common.csv",
+                            "data/2gram.csv.gz", "wordlist_bigrams.txt"};
+    struct Words prefixes = {0}, common = {0};
+    int *word_prefix = NULL, n_threads = 0, opt, i, word_bits;
+    const char *store_path = NULL, *binary_path = NULL;
+    char *spellings = NULL;
+    size_t n_pairs = 0, spellings_len = 0;
+    int reorder = 0, *new_number = NULL;
+
+    while ((opt = getopt(argc, argv, "j:e:rb:")) != -1) {
+        if (opt == 'e')
+            store_path = optarg;
+        else if (opt == 'b')
+            binary_path = optarg;
+        else if (opt == 'r')
+            reorder = 1;
+        else if (opt != 'j' || (n_threads = atoi(optarg)) < 1)
+            usage(argv[0]);
+    }
+    if (argc - optind == 4)
+        memcpy(paths, argv + optind, sizeof(paths));
+    else if (argc != optind)
+        usage(argv[0]);
+    if (!n_threads)
+        n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    int stale = store_path && store_stale(store_path, paths[2]);
+    progress_start("digest", stale ? "store" : "common", argc, argv);
+    if (stale) {
+        build_store(paths[2], store_path, n_threads);
+        progress_phase("common");
+    }
+
+    read_prefixes(paths[0], &prefixes);
+    build_common(paths[1], &prefixes, &common, &word_prefix, &spellings,
+                 &spellings_len);
+    for (word_bits = 1; 1 << word_bits <= common.n; word_bits++)
+        ;
+
+    size_t transitions_len = ((size_t)prefixes.n * prefixes.n + 7) / 8;
+    struct Parser *parsers = calloc(n_threads, sizeof(*parsers));
+    for (i = 0; i < n_threads; i++) {
+        parsers[i].common = &common;
+        parsers[i].prefixes = &prefixes;
+        parsers[i].word_prefix = word_prefix;
+        parsers[i].word_bits = word_bits;
+        parsers[i].key_a = malloc(common.max_len + 1);
+        parsers[i].key_b = malloc(common.max_len + 1);
+        parsers[i].key_cap = common.max_len;
+        parsers[i].transitions = calloc(transitions_len, 1);
+    }
+    progress_phase("parse");
+    if (store_path)
+        store_pairs(store_path, &parsers[0]);
+    else
+        build_edges(paths[2], parsers, n_threads);
+
+    /* gather the pairs and attested prefix pairs of all threads */
+    for (i = 0; i < n_threads; i++)
+        n_pairs += parsers[i].n_pairs;
+    uint64_t *pairs = malloc((n_pairs ? n_pairs : 1) * sizeof(*pairs));
+    size_t j, n_transitions = 0;
+    n_pairs = 0;
+    for (i = 0; i < n_threads; i++) {
+        memcpy(pairs + n_pairs, parsers[i].pairs,
+               parsers[i].n_pairs * sizeof(*pairs));
+        n_pairs += parsers[i].n_pairs;
+        free(parsers[i].pairs);
+        for (j = 0; j < transitions_len; j++)
+            parsers[0].transitions[j] |= parsers[i].transitions[j];
+    }
+    for (j = 0; j < transitions_len; j++)
+        n_transitions += __builtin_popcount(parsers[0].transitions[j]);
+    printf("Attested prefix-prefix combinations: %.2f%%\n",
+           100.0 * n_transitions / (1.0 * prefixes.n * prefixes.n));
+
+    progress_phase("sort");
+    radix_sort(pairs, NULL, n_pairs, 2 * word_bits);
+    if (reorder) {
+        progress_phase("reorder");
+        size_t before = write_followers(NULL, pairs, n_pairs, common.n + 1,
+                                        word_bits);
+        size_t n_unique = 0;
+        for (j = 0; j < n_pairs; j++)
+            if (!n_unique || pairs[j] != pairs[n_unique - 1])
+                pairs[n_unique++] = pairs[j];
+        n_pairs = n_unique;
+        new_number = reorder_words(pairs, n_pairs, common.n + 1, word_bits);
+        renumber_pairs(pairs, n_pairs, new_number, word_bits);
+        size_t after = write_followers(NULL, pairs, n_pairs, common.n + 1,
+                                       word_bits);
+        printf("reordered: follower lists %zu -> %zu bytes (%+.1f%%)\n",
+               before, after, 100.0 * after / before - 100);
+        if (after >= before) {
+            /* no gain, so keep the frequency order, which needs no rank
+               section */
+            int *old_number = malloc((common.n + 1) * sizeof(*old_number));
+            for (i = 0; i <= common.n; i++)
+                old_number[new_number[i]] = i;
+            renumber_pairs(pairs, n_pairs, old_number, word_bits);
+            free(old_number);
+            free(new_number);
+            new_number = NULL;
+            reorder = 0;
+            printf("reordered: no smaller, keeping the frequency order\n");
+        }
+    }
+    progress_phase("write");
+    FILE *out = create_output(paths[3]);
+    fprintf(out, "%d\n", common.n + 1);
+    if (!new_number) {
+        fwrite(spellings, 1, spellings_len, out);
+        write_followers(out, pairs, n_pairs, common.n + 1, word_bits);
+    } else {
+        /* the words in their new order */
+        char **lines = malloc((common.n + 1) * sizeof(*lines)), *line;
+        for (i = 1, line = spellings; i <= common.n; i++) {
+            lines[new_number[i]] = line;
+            line = strchr(line, '\n') + 1;
+        }
+        for (i = 1; i <= common.n; i++)
+            fwrite(lines[i], 1, strchr(lines[i], '\n') + 1 - lines[i], out);
+        write_followers(out, pairs, n_pairs, common.n + 1, word_bits);
+        write_ranks(out, new_number, common.n + 1);
+        free(lines);
+    }
+    if (fclose(out))
+        err(2, "unable to write %s", paths[3]);
+    if (binary_path) {
+        progress_phase("binary");
+        write_blocked(binary_path, spellings, new_number, pairs, n_pairs,
+                      common.n + 1, word_bits, n_threads);
+    }
+    free(new_number);
+    /* the count, the words, their followers and maybe the ranks */
+    progress_output(0, 1 + 2 * common.n + 1 + 2 * reorder, 0);
+    progress_finish();
+    return 0;
+}
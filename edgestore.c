@@ -0,0 +1,121 @@
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "edgestore.h"
+
+void edge_store_open(struct EdgeStore *s, const char *path) {
+  struct EdgeStoreHeader header;
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0 || fstat(fd, &st))
+    err(2, "unable to open %s", path);
+  if (st.st_size < (off_t)sizeof(header))
+    errx(2, "%s: truncated edge store", path);
+  s->map_len = st.st_size;
+  s->map = mmap(NULL, s->map_len, PROT_READ, MAP_SHARED, fd, 0);
+  if (s->map == MAP_FAILED)
+    err(2, "unable to map %s", path);
+  close(fd);
+
+  memcpy(&header, s->map, sizeof(header));
+  if (memcmp(header.magic, EDGE_STORE_MAGIC, sizeof(header.magic)))
+    errx(2, "%s: not an edge store", path);
+  s->n_words = header.n_words;
+  s->n_pairs = header.n_pairs;
+
+  size_t columns = sizeof(header) + 2 * (s->n_words + 1) * sizeof(uint64_t) +
+                   s->n_pairs * (sizeof(uint64_t) + sizeof(uint32_t));
+  if (columns > s->map_len)
+    errx(2, "%s: truncated edge store", path);
+  const char *p = (const char *)s->map + sizeof(header);
+  s->word_offs = (const uint64_t *)p;
+  p += (s->n_words + 1) * sizeof(uint64_t);
+  s->rows = (const uint64_t *)p;
+  p += (s->n_words + 1) * sizeof(uint64_t);
+  s->counts = (const uint64_t *)p;
+  p += s->n_pairs * sizeof(uint64_t);
+  s->followers = (const uint32_t *)p;
+  p += s->n_pairs * sizeof(uint32_t);
+  s->words = p;
+  if (columns + s->word_offs[s->n_words] != s->map_len ||
+      s->rows[s->n_words] != s->n_pairs)
+    errx(2, "%s: corrupt edge store", path);
+  madvise(s->map, s->map_len, MADV_WILLNEED);
+}
+
+void edge_store_close(struct EdgeStore *s) {
+  munmap(s->map, s->map_len);
+}
+
+static int word_cmp(const char *a, size_t a_len, const char *b, size_t b_len) {
+  int c = memcmp(a, b, a_len < b_len ? a_len : b_len);
+  if (c)
+    return c;
+  return a_len < b_len ? -1 : a_len > b_len;
+}
+
+int64_t edge_store_find(const struct EdgeStore *s, const char *word,
+                        size_t len) {
+  uint64_t lo = 0, hi = s->n_words;
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    int c = word_cmp(s->words + s->word_offs[mid],
+                     s->word_offs[mid + 1] - s->word_offs[mid], word, len);
+    if (!c)
+      return mid;
+    if (c < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return -1;
+}
+
+static void write_all(FILE *f, const void *data, size_t size, size_t n,
+                      const char *path) {
+  if (fwrite(data, size, n, f) != n)
+    err(2, "unable to write %s", path);
+}
+
+void edge_store_write(const char *path, uint64_t n_words,
+                      const uint64_t *word_offs, const char *words,
+                      uint64_t n_pairs, const uint64_t *keys,
+                      const uint64_t *counts, int word_bits) {
+  struct EdgeStoreHeader header;
+  char tmp_path[4096];
+  uint64_t i, word = 0, row = 0;
+  FILE *f;
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  if (!(f = fopen(tmp_path, "w")))
+    err(2, "unable to create %s", tmp_path);
+  memcpy(header.magic, EDGE_STORE_MAGIC, sizeof(header.magic));
+  header.n_words = n_words;
+  header.n_pairs = n_pairs;
+  write_all(f, &header, sizeof(header), 1, tmp_path);
+  write_all(f, word_offs, sizeof(*word_offs), n_words + 1, tmp_path);
+
+  /* rows from the sorted keys */
+  for (word = 0; word <= n_words; word++) {
+    while (row < n_pairs && keys[row] >> word_bits < word)
+      row++;
+    write_all(f, &row, sizeof(row), 1, tmp_path);
+  }
+  write_all(f, counts, sizeof(*counts), n_pairs, tmp_path);
+  for (i = 0; i < n_pairs; i++) {
+    uint32_t follower = keys[i] & (((uint64_t)1 << word_bits) - 1);
+    write_all(f, &follower, sizeof(follower), 1, tmp_path);
+  }
+  write_all(f, words, 1, word_offs[n_words], tmp_path);
+  if (fflush(f) || fsync(fileno(f)) || fclose(f))
+    err(2, "unable to write %s", tmp_path);
+  if (rename(tmp_path, path))
+    err(2, "unable to rename %s to %s", tmp_path, path);
+}
@@ -0,0 +1,49 @@
+#ifndef EDGESTORE_H
+#define EDGESTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Every word pair of the 2-gram corpus with its total count, in a file that
+   is memory-mapped to rebuild the word graph for a new vocabulary. Words are
+   lowercase and numbered in byte order. The pairs of each word are a sorted
+   row of followers. The file is a header followed by these columns:
+
+     uint64_t word_offs[n_words + 1]  offsets of the words in words
+     uint64_t rows[n_words + 1]       word i's pairs are rows[i]..rows[i+1]
+     uint64_t counts[n_pairs]
+     uint32_t followers[n_pairs]
+     char words[word_offs[n_words]] */
+
+#define EDGE_STORE_MAGIC "ABEDGES1"
+
+struct EdgeStoreHeader {
+  char magic[8];
+  uint64_t n_words, n_pairs;
+};
+
+/* A mapped store. */
+struct EdgeStore {
+  void *map;
+  size_t map_len;
+  uint64_t n_words, n_pairs;
+  const uint64_t *word_offs, *rows, *counts;
+  const uint32_t *followers;
+  const char *words;
+};
+
+void edge_store_open(struct EdgeStore *s, const char *path);
+void edge_store_close(struct EdgeStore *s);
+
+/* The number of a word, or -1 if it isn't in the store. */
+int64_t edge_store_find(const struct EdgeStore *s, const char *word,
+                        size_t len);
+
+/* Write a store from sorted words and pairs sorted by key, where a key is
+   word << word_bits | follower. The file is replaced atomically. */
+void edge_store_write(const char *path, uint64_t n_words,
+                      const uint64_t *word_offs, const char *words,
+                      uint64_t n_pairs, const uint64_t *keys,
+                      const uint64_t *counts, int word_bits);
+
+#endif
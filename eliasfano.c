@@ -0,0 +1,230 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "eliasfano.h"
+
+/* A list's place in the bit array. Positions are absolute bit offsets. */
+struct View {
+  const uint64_t *bits;
+  uint64_t samples1, samples0, low, high;
+  int n, l, bitmap;
+};
+
+static int low_bits(uint64_t n, uint64_t universe) {
+  int l = 0;
+  while (n && universe >> (l + 1) >= n)
+    l++;
+  return l;
+}
+
+static int is_bitmap(uint64_t n, uint64_t universe, int l) {
+  return n && n * l + n + (universe >> l) + 1 >= universe;
+}
+
+static void view(const struct EliasFano *ef, int list, struct View *v) {
+  v->bits = ef->bits;
+  v->n = ef->len[list];
+  v->l = low_bits(v->n, ef->universe);
+  v->bitmap = is_bitmap(v->n, ef->universe, v->l);
+  if (v->bitmap)
+    v->l = 0;
+  int n1 = v->n ? (v->n - 1) / EF_SAMPLE : 0;
+  int n0 = v->n && !v->bitmap ? (ef->universe >> v->l) / EF_SAMPLE : 0;
+  v->samples1 = ef->start[list];
+  v->samples0 = v->samples1 + 32 * (uint64_t)n1;
+  v->low = v->samples0 + 32 * (uint64_t)n0;
+  v->high = v->low + (uint64_t)v->n * v->l;
+}
+
+/* Bits can straddle two words. The array has a word of padding, so
+   reading past the end of the last list is safe. */
+static uint64_t get_bits(const uint64_t *bits, uint64_t pos, int width) {
+  uint64_t w = bits[pos / 64] >> pos % 64;
+  if (pos % 64 && pos % 64 + width > 64)
+    w |= bits[pos / 64 + 1] << (64 - pos % 64);
+  return width == 64 ? w : w & ((1ULL << width) - 1);
+}
+
+static void set_bits(uint64_t *bits, uint64_t pos, int width, uint64_t val) {
+  if (!width)
+    return;
+  bits[pos / 64] |= val << pos % 64;
+  if (pos % 64 && pos % 64 + width > 64)
+    bits[pos / 64 + 1] |= val >> (64 - pos % 64);
+}
+
+/* the position of the set bit of w with k set bits below it */
+static int select_in_word(uint64_t w, int k) {
+  while (k--)
+    w &= w - 1;
+  return __builtin_ctzll(w);
+}
+
+/* the position of the m-th set bit (from 1) at or after pos, or of the
+   m-th clear bit if invert */
+static uint64_t scan(const uint64_t *bits, uint64_t pos, int m, int invert) {
+  for (;;) {
+    uint64_t w = get_bits(bits, pos, 64) ^ (invert ? ~0ULL : 0);
+    int c = __builtin_popcountll(w);
+    if (c >= m)
+      return pos + select_in_word(w, m - 1);
+    m -= c;
+    pos += 64;
+  }
+}
+
+/* the position of set bit k (from 0) of the high bits, or of clear bit k
+   if invert, starting from the nearest sample */
+static uint64_t select_high(const struct View *v, int k, int invert) {
+  int j = k / EF_SAMPLE, r = k - j * EF_SAMPLE;
+  if (!j)
+    return scan(v->bits, v->high, k + 1, invert);
+  uint64_t sample = get_bits(v->bits, (invert ? v->samples0 : v->samples1) +
+                                          32 * (uint64_t)(j - 1), 32);
+  if (!r)
+    return v->high + sample;
+  return scan(v->bits, v->high + sample + 1, r, invert);
+}
+
+struct EliasFano *ef_alloc(int n_lists, int universe, const int *lens) {
+  struct EliasFano *ef = calloc(1, sizeof *ef);
+  struct View v;
+  int i;
+  ef->n_lists = n_lists;
+  ef->universe = universe;
+  ef->len = malloc(n_lists * sizeof ef->len[0]);
+  ef->start = malloc((n_lists + 1) * sizeof ef->start[0]);
+  ef->start[0] = 0;
+  for (i = 0; i < n_lists; i++) {
+    ef->len[i] = lens[i];
+    view(ef, i, &v);
+    ef->start[i + 1] = v.high;
+    if (lens[i])
+      ef->start[i + 1] += v.bitmap ? (uint64_t)universe
+                                   : (uint64_t)lens[i] + (universe >> v.l) + 1;
+  }
+  /* a word of padding for get_bits */
+  ef->bits = calloc(ef->start[n_lists] / 64 + 2, sizeof ef->bits[0]);
+  return ef;
+}
+
+void ef_free(struct EliasFano *ef) {
+  free(ef->len);
+  free(ef->start);
+  free(ef->bits);
+  free(ef);
+}
+
+void ef_set(struct EliasFano *ef, int list, const int *nums) {
+  struct View v;
+  int i, b, len = ef->len[list];
+  uint64_t u = ef->universe, *bits = ef->bits;
+
+  view(ef, list, &v);
+
+  for (i = 0; i < len; i++) {
+    uint64_t pos = v.bitmap ? (uint64_t)nums[i] : (uint64_t)(nums[i] >> v.l) + i;
+    bits[(v.high + pos) / 64] |= 1ULL << (v.high + pos) % 64;
+    set_bits(bits, v.low + (uint64_t)i * v.l, v.l,
+             nums[i] & ((1ULL << v.l) - 1));
+    if (i && i % EF_SAMPLE == 0)
+      set_bits(bits, v.samples1 + 32 * (uint64_t)(i / EF_SAMPLE - 1), 32,
+               pos);
+  }
+  /* clear bit b of the high bits ends the numbers with high part b */
+  for (b = 0, i = 0; len && !v.bitmap && b <= (int)(u >> v.l); b++) {
+    while (i < len && nums[i] >> v.l <= b)
+      i++;
+    if (b && b % EF_SAMPLE == 0)
+      set_bits(bits, v.samples0 + 32 * (uint64_t)(b / EF_SAMPLE - 1), 32,
+               b + i);
+  }
+}
+
+size_t ef_bytes(const struct EliasFano *ef) {
+  return (ef->start[ef->n_lists] / 64 + 2) * 8 +
+         ef->n_lists * (sizeof ef->len[0] + sizeof ef->start[0]);
+}
+
+int ef_get(const struct EliasFano *ef, int list, int i) {
+  struct View v;
+  view(ef, list, &v);
+  uint64_t pos = select_high(&v, i, 0) - v.high;
+  if (v.bitmap)
+    return pos;
+  return (pos - i) << v.l | get_bits(v.bits, v.low + (uint64_t)i * v.l, v.l);
+}
+
+int ef_next_geq(const struct EliasFano *ef, int list, int x) {
+  struct View v;
+  uint64_t pos;
+  int i;
+  if (x < 0)
+    x = 0;
+  if (x >= ef->universe)
+    return ef->universe;
+  view(ef, list, &v);
+  if (!v.n)
+    return ef->universe;
+
+  if (v.bitmap) {
+    for (pos = x; pos < (uint64_t)ef->universe; pos += 64 - pos % 64) {
+      uint64_t w = get_bits(v.bits, v.high + pos, 64 - pos % 64);
+      if (w) {
+        pos += __builtin_ctzll(w);
+        return pos < (uint64_t)ef->universe ? (int)pos : ef->universe;
+      }
+    }
+    return ef->universe;
+  }
+
+  /* skip to the first number with high part x >> l */
+  int h = x >> v.l;
+  pos = h ? select_high(&v, h - 1, 1) + 1 : v.high;
+  i = pos - v.high - h;
+  while (i < v.n) {
+    uint64_t w = get_bits(v.bits, pos, 64);
+    if (!w) {
+      pos += 64;
+      continue;
+    }
+    pos += __builtin_ctzll(w);
+    int num = (pos - v.high - i) << v.l |
+              get_bits(v.bits, v.low + (uint64_t)i * v.l, v.l);
+    if (num >= x)
+      return num;
+    i++;
+    pos++;
+  }
+  return ef->universe;
+}
+
+int ef_intersects(const struct EliasFano *ef, int list, const int *a,
+                  int len) {
+  int i = 0;
+  while (i < len) {
+    int next = ef_next_geq(ef, list, a[i]);
+    if (next == a[i])
+      return 1;
+    if (next >= ef->universe)
+      return 0;
+    while (i < len && a[i] < next)
+      i++;
+  }
+  return 0;
+}
+
+int ef_intersect(const struct EliasFano *ef, int list, const int *a, int len,
+                 int *out) {
+  int i = 0, n = 0;
+  while (i < len) {
+    int next = ef_next_geq(ef, list, a[i]);
+    if (next >= ef->universe)
+      break;
+    if (next == a[i])
+      out[n++] = a[i++];
+    while (i < len && a[i] < next)
+      i++;
+  }
+  return n;
+}
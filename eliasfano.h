@@ -0,0 +1,52 @@
+#ifndef ELIASFANO_H
+#define ELIASFANO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Increasing lists of numbers in [0, universe), Elias-Fano coded back to
+   back in one bit array. A list of n numbers keeps the low l bits of each
+   number in a packed array, with l = floor(log2(universe / n)), and the
+   rest in unary: number i sets bit (number >> l) + i of a bit string with
+   one bit per possible high part and per number. A list that would take
+   more bits that way than universe is a bitmap instead.
+
+   Each list starts with samples of the positions of every EF_SAMPLE-th
+   set bit and of every EF_SAMPLE-th clear bit in its high bits. Getting a
+   number or the first number at least x then takes a sample lookup and a
+   scan of a few words. */
+
+#define EF_SAMPLE 256
+
+struct EliasFano {
+  int n_lists, universe;
+  uint32_t *len;
+  uint64_t *start; /* bit offset of each list, and the end */
+  uint64_t *bits;
+};
+
+/* Lists take a number of bits set by their length, so the lengths are
+   given up front and the bits allocated once. */
+struct EliasFano *ef_alloc(int n_lists, int universe, const int *lens);
+void ef_free(struct EliasFano *ef);
+
+/* Fill in a list with its lens[list] numbers, which must be increasing. */
+void ef_set(struct EliasFano *ef, int list, const int *nums);
+
+/* The bytes taken by the lists and their index. */
+size_t ef_bytes(const struct EliasFano *ef);
+
+int ef_get(const struct EliasFano *ef, int list, int i);
+
+/* The first number of the list at least x, or universe if there is none. */
+int ef_next_geq(const struct EliasFano *ef, int list, int x);
+
+/* Whether the list has any of the len numbers of a, which must be
+   increasing, and their intersection. Both skip through the list with
+   ef_next_geq rather than decoding it. */
+int ef_intersects(const struct EliasFano *ef, int list, const int *a,
+                  int len);
+int ef_intersect(const struct EliasFano *ef, int list, const int *a, int len,
+                 int *out);
+
+#endif
@@ -0,0 +1,333 @@
+/* write a random word graph in the format of wordlist_bigrams.txt, shaped
+   like the real one, for benchmarking and testing at scales the corpus
+   doesn't reach.
+
+   Words are numbered by frequency. Word w has about c * w^-a followers,
+   with c chosen for the requested mean degree, and followers are drawn
+   with probability proportional to their number^-b, so frequent words
+   both have and are the most followers. Only a share of the prefix pairs
+   are attested, and words only follow words with an attested pair. As
+   in the real graph, word 0 has no followers.
+
+   Output is deterministic for a seed. With -o the graph is validated and
+   written in the binary format of wordgraph.h instead, with block coded
+   follower lists if -B is given. */
+
+#include <err.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "wordgraph.h"
+
+#define PREFIX_EXPONENT 0.5
+#define MAX_ROUNDS 8
+
+struct Graph {
+  int n_words, n_prefixes;
+  double degree_exp, follower_exp, density;
+  char (*prefixes)[PREFIX_LEN];
+  int *word_prefix;
+  uint8_t *attested; /* n_prefixes^2 bits: can prefix i be followed by j */
+  double *degree_weight;   /* word^-degree_exp */
+  double *follower_weight; /* word^-follower_exp, summing to 1 */
+};
+
+static uint64_t rng_state;
+
+static uint64_t rng_next() {
+  uint64_t x = (rng_state += 0x9e3779b97f4a7c15ULL);
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/* uniform in [0, 1) */
+static double rng_uniform() {
+  return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* a number in [1, n) with probability proportional to number^-exp, by
+   inverting the continuous distribution */
+static int zipf(int n, double exp) {
+  double u = rng_uniform(), x;
+  if (fabs(exp - 1) < 1e-9)
+    x = pow(n, u);
+  else
+    x = pow(u * (pow(n, 1 - exp) - 1) + 1, 1 / (1 - exp));
+  return x < 1 ? 1 : x >= n ? n - 1 : (int)x;
+}
+
+static int attested(struct Graph *g, int a, int b) {
+  size_t bit = (size_t)g->word_prefix[a] * g->n_prefixes + g->word_prefix[b];
+  return g->attested[bit / 8] >> bit % 8 & 1;
+}
+
+static int degree(struct Graph *g, int word, double scale) {
+  double d = scale * g->degree_weight[word];
+  return d > g->n_words - 1 ? g->n_words - 1 : (int)(d + 0.5);
+}
+
+/* find the scale that gives the requested mean degree, which is off from
+   the sum of the power law where degrees are capped at the word count */
+static double degree_scale(struct Graph *g, double mean) {
+  double lo = 0, hi = mean * g->n_words, norm = 0;
+  int i, word;
+  g->degree_weight = malloc(g->n_words * sizeof g->degree_weight[0]);
+  g->follower_weight = malloc(g->n_words * sizeof g->follower_weight[0]);
+  for (word = 1; word < g->n_words; word++) {
+    g->degree_weight[word] = pow(word, -g->degree_exp);
+    norm += g->follower_weight[word] = pow(word, -g->follower_exp);
+  }
+  for (word = 1; word < g->n_words; word++)
+    g->follower_weight[word] /= norm;
+  for (i = 0; i < 60; i++) {
+    double mid = (lo + hi) / 2, total = 0;
+    for (word = 1; word < g->n_words; word++)
+      total += degree(g, word, mid);
+    if (total < mean * g->n_words)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return hi;
+}
+
+static void make_prefixes(struct Graph *g) {
+  uint8_t used[26 * 26 * 26] = {0};
+  double *cdf = malloc(g->n_prefixes * sizeof *cdf), total = 0;
+  int *n_words = calloc(g->n_prefixes, sizeof *n_words);
+  int i, word;
+
+  g->prefixes = malloc(g->n_prefixes * sizeof g->prefixes[0]);
+  for (i = 0; i < g->n_prefixes; i++) {
+    int p;
+    do
+      p = rng_next() % (26 * 26 * 26);
+    while (used[p]);
+    used[p] = 1;
+    g->prefixes[i][0] = 'a' + p / 676;
+    g->prefixes[i][1] = 'a' + p / 26 % 26;
+    g->prefixes[i][2] = 'a' + p % 26;
+    cdf[i] = total += pow(i + 1, -PREFIX_EXPONENT);
+  }
+
+  /* some prefixes have many more words than others */
+  g->word_prefix = malloc(g->n_words * sizeof *g->word_prefix);
+  g->word_prefix[0] = 0;
+  for (word = 1; word < g->n_words; word++) {
+    double u = rng_uniform() * total;
+    int lo = 0, hi = g->n_prefixes - 1;
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (cdf[mid] < u)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    g->word_prefix[word] = lo;
+    n_words[lo]++;
+  }
+  /* every prefix needs a word, taken from the least frequent ones */
+  for (i = 0, word = g->n_words - 1; i < g->n_prefixes; i++) {
+    while (!n_words[i]) {
+      if (n_words[g->word_prefix[word]] > 1) {
+        n_words[g->word_prefix[word]]--;
+        g->word_prefix[word] = i;
+        n_words[i]++;
+      }
+      word--;
+    }
+  }
+
+  size_t bits = (size_t)g->n_prefixes * g->n_prefixes;
+  g->attested = calloc(bits / 8 + 1, 1);
+  for (i = 0; i < (int)bits; i++)
+    if (rng_uniform() < g->density)
+      g->attested[i / 8] |= 1 << i % 8;
+  free(cdf);
+  free(n_words);
+}
+
+/* the name of each word but 0: its prefix and a base-26 count of the words
+   before it with that prefix */
+static char **make_words(struct Graph *g) {
+  int *counts = calloc(g->n_prefixes, sizeof *counts), word;
+  char **words = calloc(g->n_words, sizeof *words);
+  for (word = 1; word < g->n_words; word++) {
+    int p = g->word_prefix[word], k = counts[p]++, len = PREFIX_LEN;
+    words[word] = malloc(PREFIX_LEN + 8);
+    memcpy(words[word], g->prefixes[p], PREFIX_LEN);
+    do {
+      words[word][len++] = 'a' + k % 26;
+      k /= 26;
+    } while (k);
+    words[word][len] = 0;
+  }
+  free(counts);
+  return words;
+}
+
+static int int_cmp(const void *a, const void *b) {
+  return *(const int *)a - *(const int *)b;
+}
+
+/* draw about d followers of word, in order */
+static int followers(struct Graph *g, int word, int d, int *out) {
+  int n = 0, round, i;
+  if (d > g->n_words / 8) {
+    /* too many to draw one at a time, so take each word with its share
+       of d instead */
+    for (i = 1; i < g->n_words; i++)
+      if (attested(g, word, i) && rng_uniform() < d * g->follower_weight[i])
+        out[n++] = i;
+    return n;
+  }
+  for (round = 0; round < MAX_ROUNDS && n < d; round++) {
+    /* out has room for 2 * n_words */
+    int want = (d - n) / g->density + 1, j;
+    if (want > 2 * g->n_words - n)
+      want = 2 * g->n_words - n;
+    for (i = 0; i < want; i++) {
+      int f = zipf(g->n_words, g->follower_exp);
+      if (attested(g, word, f))
+        out[n++] = f;
+    }
+    qsort(out, n, sizeof *out, int_cmp);
+    for (i = j = 0; i < n; i++)
+      if (!j || out[i] != out[j - 1])
+        out[j++] = out[i];
+    n = j < d ? j : d;
+    /* keep an unbiased subset if the round overshot */
+    for (i = d; i < j; i++) {
+      int k = rng_next() % (i + 1);
+      if (k < d)
+        out[k] = out[i];
+    }
+    qsort(out, n, sizeof *out, int_cmp);
+  }
+  return n;
+}
+
+static void usage(const char *name) {
+  errx(1, "usage: %s [-n WORDS] [-p PREFIXES] [-d DEGREE] [-a EXP] [-b EXP]\n"
+       "          [-t DENSITY] [-s SEED] [-o OUT.bin [-B]] > graph.txt\n"
+       "  -n WORDS    number of words, counting word 0 (default 57105)\n"
+       "  -p N        number of prefixes; abbrase needs 1024 (default 1024)\n"
+       "  -d DEGREE   mean number of followers (default 350)\n"
+       "  -a EXP      power law of the number of followers by frequency\n"
+       "              rank (default 0.75)\n"
+       "  -b EXP      power law of how often a word is a follower by\n"
+       "              frequency rank (default 0.75)\n"
+       "  -t DENSITY  share of prefix pairs with followers (default 0.87)\n"
+       "  -s SEED     random seed (default 1)\n"
+       "  -o OUT.bin  write the graph in the binary format, validated,\n"
+       "              instead of as text to stdout\n"
+       "  -B          with -o, block code its follower lists", name);
+}
+
+int main(int argc, char *argv[]) {
+  struct Graph g = {.n_words = 57105, .n_prefixes = MAX_PREFIXES,
+                    .degree_exp = 0.75, .follower_exp = 0.75,
+                    .density = 0.87};
+  double mean = 350;
+  const char *out_file = NULL;
+  int opt, word, blocked = 0;
+
+  rng_state = 1;
+  while ((opt = getopt(argc, argv, "n:p:d:a:b:t:s:o:B")) != -1) {
+    switch (opt) {
+    case 'n':
+      g.n_words = atoi(optarg);
+      break;
+    case 'p':
+      g.n_prefixes = atoi(optarg);
+      break;
+    case 'd':
+      mean = atof(optarg);
+      break;
+    case 'a':
+      g.degree_exp = atof(optarg);
+      break;
+    case 'b':
+      g.follower_exp = atof(optarg);
+      break;
+    case 't':
+      g.density = atof(optarg);
+      break;
+    case 's':
+      rng_state = strtoull(optarg, NULL, 10);
+      break;
+    case 'o':
+      out_file = optarg;
+      break;
+    case 'B':
+      blocked = 1;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind != argc || (blocked && !out_file))
+    usage(argv[0]);
+  if (g.n_prefixes < 1 || g.n_prefixes > MAX_PREFIXES)
+    errx(1, "the number of prefixes must be in [1, %d]", MAX_PREFIXES);
+  if (g.n_words <= g.n_prefixes)
+    errx(1, "need more words than prefixes");
+  if (g.density <= 0 || g.density > 1 || mean < 0)
+    errx(1, "density must be in (0, 1] and degree at least 0");
+
+  make_prefixes(&g);
+  double scale = degree_scale(&g, mean);
+  static char buf[1 << 20];
+  setvbuf(stdout, buf, _IOFBF, sizeof buf);
+  /* a binary graph is built in memory and written at the end, while text
+     is written as it goes */
+  struct WordGraph *wg = calloc(1, sizeof *wg);
+  wg->n_words = g.n_words;
+  wg->words = make_words(&g);
+  if (out_file) {
+    wg->followers_compressed = calloc(g.n_words,
+                                      sizeof wg->followers_compressed[0]);
+    wg->followers_compressed[0] = strdup("");
+  } else {
+    printf("%d\n", g.n_words);
+    for (word = 1; word < g.n_words; word++)
+      printf("%s\n", wg->words[word]);
+    putchar('\n');
+  }
+
+  int *out = malloc(2 * (size_t)g.n_words * sizeof *out);
+  size_t edges = 0, bytes = 0;
+  for (word = 1; word < g.n_words; word++) {
+    int n = followers(&g, word, degree(&g, word, scale), out);
+    char *enc = encode(out, n);
+    edges += n;
+    bytes += strlen(enc);
+    if (out_file) {
+      wg->followers_compressed[word] = enc;
+    } else {
+      fputs(enc, stdout);
+      putchar('\n');
+      free(enc);
+    }
+  }
+  if (out_file) {
+    if (wordgraph_validate(wg, sysconf(_SC_NPROCESSORS_ONLN)) >= 0)
+      errx(3, "generated an invalid graph");
+    wordgraph_write_binary(wg, out_file, blocked);
+  } else if (fflush(stdout)) {
+    err(2, "write failed");
+  }
+  wordgraph_free(wg);
+  free(out);
+  fprintf(stderr, "%d words, %d prefixes, %zu edges (mean %.1f), "
+          "%.1f MB of follower lists\n", g.n_words, g.n_prefixes, edges,
+          (double)edges / g.n_words, bytes / 1e6);
+  return 0;
+}
@@ -0,0 +1,72 @@
+/* check that every follower list of a graph decodes to increasing word
+   numbers of the graph, on several threads, and optionally write the graph
+   in the checksummed binary format, marked validated so abbrase can load
+   it without checking again. With -b, the follower lists are block coded
+   (see blockcode.h) rather than printable.
+
+   Exits with 3 if the graph is invalid. */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "wordgraph.h"
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *name) {
+  errx(1, "usage: %s [-j THREADS] [-b] [-o OUT.bin] <graph>\n"
+       "  -j THREADS  number of threads (default: all cores)\n"
+       "  -o OUT.bin  write the validated graph in the binary format\n"
+       "  -b          block code its follower lists", name);
+}
+
+int main(int argc, char *argv[]) {
+  long n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *in = NULL, *out = NULL;
+  int i, blocked = 0;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-j") && i + 1 < argc)
+      n_threads = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+      out = argv[++i];
+    else if (!strcmp(argv[i], "-b"))
+      blocked = 1;
+    else if (!in)
+      in = argv[i];
+    else
+      usage(argv[0]);
+  }
+  if (!in || n_threads < 1)
+    usage(argv[0]);
+
+  double start = now();
+  struct WordGraph *g = wordgraph_init(in);
+  double loaded = now();
+  int bad = wordgraph_validate(g, n_threads);
+  double checked = now();
+  if (bad >= 0)
+    errx(3, "%s is invalid", in);
+
+  size_t edges = 0;
+  for (i = 0; i < g->n_words; i++) {
+    struct IntVec *followers = wordgraph_followers(g, i);
+    edges += followers->len;
+    intvec_free(followers);
+  }
+  fprintf(stderr, "%s: %d words, %zu edges, valid (load %.3fs, check %.3fs "
+          "on %ld threads)\n", in, g->n_words, edges, loaded - start,
+          checked - loaded, n_threads);
+  if (out)
+    wordgraph_write_binary(g, out, blocked);
+  wordgraph_free(g);
+  return 0;
+}
@@ -0,0 +1,483 @@
+/* express a new graph as a patch against a base graph, or apply one.
+
+   graphdiff BASE NEW PATCH writes a patch that turns BASE into NEW, and
+   graphdiff -a BASE PATCH [OUT.bin] applies it, writing the new graph in
+   the binary format, with block coded follower lists if BASE has them.
+   Either graph can be text or binary, but only a binary BASE can be
+   patched in place by leaving OUT out.
+
+   A patch is gzipped, and holds:
+   - a header: the word counts and fingerprints of both graphs, and
+     whether the new one has ranks
+   - the new word list, as runs of base words (a start and a count) and
+     runs of new words (their strings)
+   - for each new word whose followers aren't those of its base word, once
+     renumbered, the gap since the last such word and the followers removed
+     and added
+   - if the new graph has ranks, the change in each word's rank from its
+     base word's
+
+   Numbers are LEB128 varints, and lists of followers are counts followed
+   by the differences from the previous follower. A vocabulary change
+   that renumbers words re-encodes every list that mentions them, but only
+   the lists that changed otherwise go in the patch. */
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "blockcode.h"
+#include "crc32c.h"
+#include "wordgraph.h"
+
+#define PATCH_MAGIC "ABPATCH1"
+#define PATCH_RANKS 1
+#define PATCH_VALIDATED 2
+
+struct Buf {
+  unsigned char *data;
+  size_t len, cap;
+};
+
+static void put_bytes(struct Buf *b, const void *data, size_t len) {
+  if (b->len + len > b->cap) {
+    b->cap = (b->len + len) * 2;
+    b->data = realloc(b->data, b->cap);
+  }
+  memcpy(b->data + b->len, data, len);
+  b->len += len;
+}
+
+static void put_varint(struct Buf *b, uint64_t n) {
+  unsigned char byte;
+  do {
+    byte = (n & 0x7f) | (n > 0x7f ? 0x80 : 0);
+    put_bytes(b, &byte, 1);
+    n >>= 7;
+  } while (n);
+}
+
+static void put_list(struct Buf *b, const int *nums, int len) {
+  int i, last = 0;
+  put_varint(b, len);
+  for (i = 0; i < len; i++) {
+    put_varint(b, nums[i] - last);
+    last = nums[i];
+  }
+}
+
+struct Reader {
+  const unsigned char *p, *end;
+};
+
+static uint64_t get_varint(struct Reader *r) {
+  uint64_t n = 0;
+  int shift = 0;
+  unsigned char byte;
+  do {
+    if (r->p == r->end || shift > 63)
+      errx(3, "corrupted patch");
+    byte = *r->p++;
+    n |= (uint64_t)(byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return n;
+}
+
+/* a count that must be at most max */
+static int get_count(struct Reader *r, int max) {
+  uint64_t n = get_varint(r);
+  if (n > (uint64_t)max)
+    errx(3, "corrupted patch");
+  return n;
+}
+
+static char *get_string(struct Reader *r) {
+  const unsigned char *nul = memchr(r->p, 0, r->end - r->p);
+  char *s = (char *)r->p;
+  if (!nul)
+    errx(3, "corrupted patch");
+  r->p = nul + 1;
+  return s;
+}
+
+/* read a list of increasing numbers in [1, n_words) into out */
+static int get_list(struct Reader *r, int n_words, int *out) {
+  int len = get_count(r, n_words), i;
+  uint64_t last = 0;
+  for (i = 0; i < len; i++) {
+    last += get_varint(r);
+    if (last >= (uint64_t)n_words || (i && (int)last <= out[i - 1]) || !last)
+      errx(3, "corrupted patch");
+    out[i] = last;
+  }
+  return len;
+}
+
+/* a checksum of the words, follower lists and ranks. Block coded lists
+   are checksummed as their printable coding, so a graph has the same
+   fingerprint either way. */
+static uint32_t fingerprint(struct WordGraph *g) {
+  uint32_t crc = 0;
+  int i;
+  for (i = 0; i < g->n_words; i++) {
+    const char *word = g->words[i] ? g->words[i] : "";
+    crc = crc32c(crc, word, strlen(word) + 1);
+    if (g->followers_compressed) {
+      crc = crc32c(crc, g->followers_compressed[i],
+                   strlen(g->followers_compressed[i]) + 1);
+    } else {
+      struct IntVec *followers = wordgraph_followers(g, i);
+      char *enc = encode(followers->data, followers->len);
+      crc = crc32c(crc, enc, strlen(enc) + 1);
+      free(enc);
+      intvec_free(followers);
+    }
+  }
+  for (i = 0; g->rank && i < g->n_words; i++) {
+    uint32_t rank = g->rank[i];
+    crc = crc32c(crc, &rank, sizeof rank);
+  }
+  return crc;
+}
+
+static int int_cmp(const void *a, const void *b) {
+  return *(const int *)a - *(const int *)b;
+}
+
+/* decode the followers of old word o into new word numbers, in order,
+   dropping the words the new graph doesn't have */
+static int translate(struct WordGraph *old, int o, const int *old_to_new,
+                     int *out) {
+  struct IntVec *followers = wordgraph_followers(old, o);
+  int i, n = 0, sorted = 1;
+  for (i = 0; i < followers->len; i++) {
+    int f = old_to_new[followers->data[i]];
+    if (!f)
+      continue;
+    sorted &= !n || f > out[n - 1];
+    out[n++] = f;
+  }
+  intvec_free(followers);
+  if (!sorted)
+    qsort(out, n, sizeof *out, int_cmp);
+  return n;
+}
+
+/* split a and b, both increasing, into the numbers only in a and only in
+   b. Returns whether they differ. */
+static int list_diff(const int *a, int a_len, const int *b, int b_len,
+                     int *only_a, int *a_out, int *only_b, int *b_out) {
+  int i = 0, j = 0;
+  *a_out = *b_out = 0;
+  while (i < a_len || j < b_len) {
+    if (j == b_len || (i < a_len && a[i] < b[j]))
+      only_a[(*a_out)++] = a[i++];
+    else if (i == a_len || b[j] < a[i])
+      only_b[(*b_out)++] = b[j++];
+    else
+      i++, j++;
+  }
+  return *a_out || *b_out;
+}
+
+/* look up words by string, for matching the new words to the base's */
+struct WordTable {
+  int *slots; /* word number, or 0 if empty */
+  size_t mask;
+  char **words;
+};
+
+static size_t word_hash(const char *s) {
+  size_t h = 14695981039346656037ULL;
+  for (; *s; s++)
+    h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+  return h;
+}
+
+static void table_init(struct WordTable *t, struct WordGraph *g) {
+  int i;
+  for (t->mask = 1; t->mask < 2 * (size_t)g->n_words; t->mask *= 2)
+    ;
+  t->slots = calloc(t->mask, sizeof *t->slots);
+  t->mask--;
+  t->words = g->words;
+  for (i = 1; i < g->n_words; i++) {
+    size_t h = word_hash(g->words[i]) & t->mask;
+    while (t->slots[h])
+      h = (h + 1) & t->mask;
+    t->slots[h] = i;
+  }
+}
+
+/* the first word with the string, or 0 if there is none */
+static int table_find(struct WordTable *t, const char *word) {
+  size_t h = word_hash(word) & t->mask;
+  for (; t->slots[h]; h = (h + 1) & t->mask)
+    if (!strcmp(t->words[t->slots[h]], word))
+      return t->slots[h];
+  return 0;
+}
+
+static uint64_t zigzag(int64_t n) { return (uint64_t)n << 1 ^ (n >> 63); }
+
+static int64_t unzigzag(uint64_t n) {
+  return (int64_t)(n >> 1) ^ -(int64_t)(n & 1);
+}
+
+static int base_rank(struct WordGraph *g, int word) {
+  return g->rank ? g->rank[word] : word;
+}
+
+static void write_patch(const char *path, struct Buf *b) {
+  gzFile gz = gzopen(path, "wb9");
+  if (!gz)
+    err(2, "unable to create %s", path);
+  if (gzwrite(gz, b->data, b->len) != (int)b->len || gzclose(gz) != Z_OK)
+    errx(2, "unable to write %s", path);
+}
+
+static void diff(const char *base_path, const char *new_path,
+                 const char *patch_path) {
+  struct WordGraph *old = wordgraph_init(base_path);
+  struct WordGraph *new = wordgraph_init(new_path);
+  struct WordTable table;
+  struct Buf b = {0};
+  int i, n_words = new->n_words;
+
+  int validated = wordgraph_validate(new, sysconf(_SC_NPROCESSORS_ONLN)) < 0;
+  put_bytes(&b, PATCH_MAGIC, sizeof PATCH_MAGIC - 1);
+  put_varint(&b, old->n_words);
+  put_varint(&b, fingerprint(old));
+  put_varint(&b, n_words);
+  put_varint(&b, fingerprint(new));
+  put_varint(&b, (new->rank ? PATCH_RANKS : 0) |
+                 (validated ? PATCH_VALIDATED : 0));
+
+  /* the new word list, as runs of base words and of new strings */
+  int *new_to_old = calloc(n_words, sizeof *new_to_old);
+  int *old_to_new = calloc(old->n_words, sizeof *old_to_new);
+  table_init(&table, old);
+  for (i = 1; i < n_words; i++) {
+    new_to_old[i] = table_find(&table, new->words[i]);
+    old_to_new[new_to_old[i]] = i;
+  }
+  old_to_new[0] = 0;
+  int copied = 0, inserted = 0;
+  for (i = 1; i < n_words;) {
+    int start = i;
+    if (new_to_old[i]) {
+      while (++i < n_words && new_to_old[i] == new_to_old[i - 1] + 1)
+        ;
+      put_varint(&b, (uint64_t)(i - start) << 1);
+      put_varint(&b, new_to_old[start]);
+      copied += i - start;
+    } else {
+      while (++i < n_words && !new_to_old[i])
+        ;
+      put_varint(&b, (uint64_t)(i - start) << 1 | 1);
+      for (; start < i; start++)
+        put_bytes(&b, new->words[start], strlen(new->words[start]) + 1);
+    }
+  }
+  inserted = n_words - 1 - copied;
+
+  /* the followers that changed */
+  int *a = malloc(2 * (size_t)n_words * sizeof *a), *c = a + n_words;
+  int *only_a = malloc(2 * (size_t)n_words * sizeof *only_a);
+  int *only_c = only_a + n_words;
+  int gap = 0, changed = 0;
+  size_t removed = 0, added = 0;
+  for (i = 0; i < n_words; i++) {
+    int a_len = 0, a_out, c_out;
+    if (new_to_old[i] || !i)
+      a_len = translate(old, new_to_old[i], old_to_new, a);
+    struct IntVec *followers = wordgraph_followers(new, i);
+    memcpy(c, followers->data, followers->len * sizeof *c);
+    if (!list_diff(a, a_len, c, followers->len, only_a, &a_out, only_c,
+                   &c_out)) {
+      gap++;
+    } else {
+      put_varint(&b, gap);
+      put_list(&b, only_a, a_out);
+      put_list(&b, only_c, c_out);
+      gap = 0;
+      changed++;
+      removed += a_out;
+      added += c_out;
+    }
+    intvec_free(followers);
+  }
+  put_varint(&b, gap);
+
+  for (i = 0; new->rank && i < n_words; i++)
+    put_varint(&b, zigzag((int64_t)new->rank[i] -
+                          (new_to_old[i] || !i ? base_rank(old, new_to_old[i])
+                                               : 0)));
+
+  write_patch(patch_path, &b);
+  fprintf(stderr, "%d words kept, %d added, %d removed; %d lists changed, "
+          "%zu followers removed and %zu added; %zu bytes before gzip\n",
+          copied, inserted, old->n_words - 1 - copied, changed, removed,
+          added, b.len);
+}
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void apply(const char *base_path, const char *patch_path,
+                  const char *out_path) {
+  double start = now();
+  struct WordGraph *old = wordgraph_init(base_path);
+  /* patching in place would turn a text graph into a binary one under
+     the same name */
+  if (!out_path && !old->map)
+    errx(1, "%s is a text graph, so give OUT.bin to write the new graph to",
+         base_path);
+  if (!out_path)
+    out_path = base_path;
+  struct Buf b = {0};
+  unsigned char buf[1 << 16];
+  int i, n;
+
+  gzFile gz = gzopen(patch_path, "rb");
+  if (!gz)
+    err(1, "unable to open %s", patch_path);
+  while ((n = gzread(gz, buf, sizeof buf)) > 0)
+    put_bytes(&b, buf, n);
+  if (n < 0 || gzclose(gz) != Z_OK)
+    errx(3, "corrupted patch");
+  put_bytes(&b, "", 1); /* so a truncated string can't run off the end */
+
+  struct Reader r = {b.data, b.data + b.len - 1};
+  if (b.len < sizeof PATCH_MAGIC ||
+      memcmp(r.p, PATCH_MAGIC, sizeof PATCH_MAGIC - 1))
+    errx(3, "%s is not a graph patch", patch_path);
+  r.p += sizeof PATCH_MAGIC - 1;
+  if (get_varint(&r) != (uint64_t)old->n_words ||
+      get_varint(&r) != fingerprint(old))
+    errx(3, "%s is not a patch for %s", patch_path, base_path);
+  int n_words = get_count(&r, INT32_MAX / 2);
+  uint32_t new_fingerprint = get_varint(&r);
+  int flags = get_varint(&r);
+
+  struct WordGraph *new = calloc(1, sizeof *new);
+  new->n_words = n_words;
+  new->words = calloc(n_words, sizeof new->words[0]);
+  /* the new lists are coded the same way as the base's */
+  if (old->blocks)
+    new->blocks = calloc(n_words + 1, sizeof new->blocks[0]);
+  else
+    new->followers_compressed = calloc(n_words, sizeof new->words[0]);
+  int *new_to_old = calloc(n_words, sizeof *new_to_old);
+  int *old_to_new = calloc(old->n_words, sizeof *old_to_new);
+  for (i = 1; i < n_words;) {
+    uint64_t tag = get_varint(&r);
+    int count = tag >> 1, end = i + count;
+    if (!count || count > n_words - i)
+      errx(3, "corrupted patch");
+    if (tag & 1) {
+      for (; i < end; i++)
+        new->words[i] = get_string(&r);
+    } else {
+      int o = get_count(&r, old->n_words - 1);
+      if (!o || count > old->n_words - o)
+        errx(3, "corrupted patch");
+      for (; i < end; i++, o++) {
+        new->words[i] = old->words[o];
+        new_to_old[i] = o;
+        old_to_new[o] = i;
+      }
+    }
+  }
+  /* with the same numbering, unchanged lists can be kept as they are */
+  int same_numbering = n_words == old->n_words;
+  for (i = 1; i < n_words && same_numbering; i++)
+    same_numbering = new_to_old[i] == i;
+
+  int *a = malloc(3 * (size_t)n_words * sizeof *a), *removed = a + n_words;
+  int *added = removed + n_words;
+  int *list = malloc(2 * (size_t)n_words * sizeof *list);
+  int next_change = get_count(&r, n_words);
+  for (i = 0; i < n_words; i++) {
+    int a_len = 0, n_removed = 0, n_added = 0, j = 0, k = 0, m = 0, len = 0;
+    if (i < next_change && same_numbering) {
+      if (old->blocks)
+        new->blocks[i] = old->blocks[i];
+      else
+        new->followers_compressed[i] = old->followers_compressed[i];
+      continue;
+    }
+    if (new_to_old[i] || !i)
+      a_len = translate(old, new_to_old[i], old_to_new, a);
+    if (i == next_change) {
+      n_removed = get_list(&r, n_words, removed);
+      n_added = get_list(&r, n_words, added);
+      next_change = i + 1 + get_count(&r, n_words - i - 1);
+    }
+    /* merge the added followers into those left after the removals */
+    while (j < a_len || k < n_added) {
+      if (k == n_added || (j < a_len && a[j] < added[k])) {
+        if (m < n_removed && removed[m] == a[j])
+          m++;
+        else
+          list[len++] = a[j];
+        j++;
+      } else {
+        list[len++] = added[k++];
+      }
+    }
+    if (m < n_removed)
+      errx(3, "corrupted patch: removes a follower word %d doesn't have", i);
+    if (old->blocks) {
+      new->blocks[i] = malloc(block_bound(len) + BLOCK_PAD);
+      block_encode(list, len, new->blocks[i]);
+    } else {
+      new->followers_compressed[i] = encode(list, len);
+    }
+  }
+  if (next_change != n_words)
+    errx(3, "corrupted patch");
+
+  if (flags & PATCH_RANKS) {
+    new->rank = malloc(n_words * sizeof new->rank[0]);
+    for (i = 0; i < n_words; i++) {
+      int64_t base = new_to_old[i] || !i ? base_rank(old, new_to_old[i]) : 0;
+      new->rank[i] = base + unzigzag(get_varint(&r));
+    }
+  }
+  if (r.p != r.end || fingerprint(new) != new_fingerprint)
+    errx(3, "patched graph doesn't match the one the patch was made from");
+  new->validated = flags & PATCH_VALIDATED;
+  wordgraph_write_binary(new, out_path, old->blocks != NULL);
+  fprintf(stderr, "applied %s to %s in %.0f ms\n", patch_path, base_path,
+          (now() - start) * 1e3);
+  /* strings point into the base graph and the patch, so the process
+     exiting frees them */
+}
+
+static void usage(const char *name) {
+  errx(1, "usage: %s BASE NEW PATCH     write a patch from BASE to NEW\n"
+       "       %s -a BASE PATCH [OUT]  apply a patch, writing the new graph\n"
+       "                                 in the binary format to OUT, or\n"
+       "                                 over BASE if BASE is binary",
+       name, name);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc == 4 && strcmp(argv[1], "-a"))
+    diff(argv[1], argv[2], argv[3]);
+  else if ((argc == 4 || argc == 5) && !strcmp(argv[1], "-a"))
+    apply(argv[2], argv[3], argc == 5 ? argv[4] : NULL);
+  else
+    usage(argv[0]);
+  return 0;
+}
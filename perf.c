@@ -0,0 +1,120 @@
+#include <err.h>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perf.h"
+
+#ifdef ABBRASE_STATS
+
+#define MAX_EVENTS 5
+
+static const struct {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+} events[MAX_EVENTS] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"L1d misses", PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+         PERF_COUNT_HW_CACHE_RESULT_MISS << 16},
+    {"LLC misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static const char *phase_names[PERF_N_PHASES] = {"load", "backward", "forward",
+                                                 "format"};
+
+int perf_enabled;
+
+static int leader = -1;
+static int n_open;
+static int opened[MAX_EVENTS]; /* indexes into events, in group order */
+static uint64_t begin[PERF_N_PHASES][MAX_EVENTS];
+static uint64_t totals[PERF_N_PHASES][MAX_EVENTS];
+static long calls[PERF_N_PHASES];
+
+/* open whichever of the events this machine supports, as one group so
+   they're read together */
+void perf_open() {
+  int i;
+  for (i = 0; i < MAX_EVENTS; i++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = events[i].type;
+    attr.config = events[i].config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.disabled = leader < 0;
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+    if (fd < 0) {
+      warn("perf counter for %s unavailable", events[i].name);
+      continue;
+    }
+    if (leader < 0)
+      leader = fd;
+    opened[n_open++] = i;
+  }
+  if (leader < 0)
+    return;
+  ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  perf_enabled = 1;
+}
+
+static void perf_read(uint64_t *values) {
+  uint64_t buf[1 + MAX_EVENTS];
+  if (read(leader, buf, sizeof buf) < (ssize_t)(sizeof(uint64_t) * (1 + n_open)))
+    err(13, "unable to read perf counters");
+  memcpy(values, buf + 1, sizeof(uint64_t) * n_open);
+}
+
+void perf_phase_begin(enum PerfPhase phase) { perf_read(begin[phase]); }
+
+void perf_phase_end(enum PerfPhase phase) {
+  uint64_t now[MAX_EVENTS];
+  int i;
+  perf_read(now);
+  for (i = 0; i < n_open; i++)
+    totals[phase][i] += now[i] - begin[phase][i];
+  calls[phase]++;
+}
+
+/* print the average counts for each phase. Loading happens once, and the
+   other phases once per password. */
+void perf_print(FILE *out) {
+  int phase, i;
+  if (!perf_enabled)
+    return;
+  fprintf(out, "%-10s", "phase");
+  for (i = 0; i < n_open; i++)
+    fprintf(out, " %14s", events[opened[i]].name);
+  fprintf(out, "\n");
+  for (phase = 0; phase < PERF_N_PHASES; phase++) {
+    double per = calls[phase] ? calls[phase] : 1;
+    fprintf(out, "%-10s", phase_names[phase]);
+    for (i = 0; i < n_open; i++)
+      fprintf(out, " %14.1f", totals[phase][i] / per);
+    fprintf(out, "\n");
+  }
+  fprintf(out, "(load is the total, other phases are per password)\n");
+}
+
+#else
+
+void perf_open() {
+  warnx("abbrase was built without stats (ABBRASE_STATS), "
+        "so --perf-counters is unavailable");
+}
+
+void perf_phase_begin(enum PerfPhase phase) { (void)phase; }
+void perf_phase_end(enum PerfPhase phase) { (void)phase; }
+void perf_print(FILE *out) { (void)out; }
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdio.h>
+
+/* Hardware performance counters for --perf-counters, attributed to the
+   phases of generating a password. Like --stats, the hooks are compiled
+   out without ABBRASE_STATS.
+
+   Counters follow the thread that opened them, so --perf-counters runs
+   the solver on the main thread only. */
+
+enum PerfPhase {
+  PERF_LOAD,
+  PERF_BACKWARD,
+  PERF_FORWARD,
+  PERF_FORMAT,
+  PERF_N_PHASES
+};
+
+#ifdef ABBRASE_STATS
+
+extern int perf_enabled;
+
+#define PERF_BEGIN(phase) (perf_enabled ? perf_phase_begin(phase) : (void)0)
+#define PERF_END(phase) (perf_enabled ? perf_phase_end(phase) : (void)0)
+
+#else
+
+#define PERF_BEGIN(phase) ((void)0)
+#define PERF_END(phase) ((void)0)
+
+#endif
+
+void perf_open();
+void perf_phase_begin(enum PerfPhase phase);
+void perf_phase_end(enum PerfPhase phase);
+void perf_print(FILE *out);
+
+#endif
@@ -0,0 +1,198 @@
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "progress.h"
+
+enum Counter {
+  BYTES_IN,
+  LINES_IN,
+  BYTES_OUT,
+  LINES_OUT,
+  BLOCKED_IN_NS,
+  BLOCKED_OUT_NS,
+  N_COUNTERS
+};
+
+static uint64_t counters[N_COUNTERS];
+
+static int log_fd = -1;
+static char stage[64], command[1024];
+static const char *phase;
+static double start_time, phase_start;
+static uint64_t last[N_COUNTERS];
+static double last_time;
+
+static pthread_t reporter;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static int finished;
+
+double progress_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void add(enum Counter c, uint64_t n) {
+  __atomic_fetch_add(&counters[c], n, __ATOMIC_RELAXED);
+}
+
+/* Append one record, with lock held. Records are written with a single
+   write to a file opened for appending, so stages running at once don't
+   interleave them. */
+static void emit(const char *event, const char *extra) {
+  uint64_t c[N_COUNTERS];
+  struct rusage usage;
+  char line[2048];
+  double t = progress_now(), interval = t - last_time;
+  int i;
+
+  if (log_fd < 0)
+    return;
+  for (i = 0; i < N_COUNTERS; i++)
+    c[i] = __atomic_load_n(&counters[i], __ATOMIC_RELAXED);
+  getrusage(RUSAGE_SELF, &usage);
+  int len = snprintf(
+      line, sizeof line,
+      "{\"stage\": \"%s\", \"pid\": %d, \"command\": \"%s\", "
+      "\"event\": \"%s\", \"phase\": \"%s\", \"elapsed_s\": %.3f, "
+      "\"bytes_in\": %llu, \"lines_in\": %llu, \"bytes_out\": %llu, "
+      "\"lines_out\": %llu, \"lines_in_per_s\": %.0f, "
+      "\"mb_in_per_s\": %.2f, \"blocked_in_s\": %.3f, "
+      "\"blocked_out_s\": %.3f, \"max_rss_mb\": %.1f%s}\n",
+      stage, (int)getpid(), command, event, phase, t - start_time,
+      (unsigned long long)c[BYTES_IN], (unsigned long long)c[LINES_IN],
+      (unsigned long long)c[BYTES_OUT], (unsigned long long)c[LINES_OUT],
+      interval > 0 ? (c[LINES_IN] - last[LINES_IN]) / interval : 0,
+      interval > 0 ? (c[BYTES_IN] - last[BYTES_IN]) / interval / 1e6 : 0,
+      c[BLOCKED_IN_NS] / 1e9, c[BLOCKED_OUT_NS] / 1e9,
+      usage.ru_maxrss / 1024.0, extra);
+  if (len >= (int)sizeof line)
+    len = sizeof line - 1;
+  if (write(log_fd, line, len) != len)
+    warn("unable to write progress record");
+  memcpy(last, c, sizeof last);
+  last_time = t;
+}
+
+static void *report(void *arg) {
+  struct timespec deadline;
+  (void)arg;
+  pthread_mutex_lock(&lock);
+  while (!finished) {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += PROGRESS_INTERVAL;
+    if (pthread_cond_timedwait(&wake, &lock, &deadline) == ETIMEDOUT)
+      emit("progress", "");
+  }
+  pthread_mutex_unlock(&lock);
+  return NULL;
+}
+
+/* Copy s into a JSON string body of at most size bytes. */
+static void json_escape(char *out, size_t size, const char *s) {
+  size_t len = 0;
+  for (; *s && len + 7 < size; s++) {
+    if (*s == '"' || *s == '\\')
+      out[len++] = '\\';
+    if ((unsigned char)*s < 0x20)
+      len += sprintf(out + len, "\\u%04x", *s);
+    else
+      out[len++] = *s;
+  }
+  out[len] = 0;
+}
+
+void progress_start(const char *name, const char *first_phase, int argc,
+                    char **argv) {
+  const char *path = getenv("ABBRASE_PROGRESS");
+  size_t len = 0;
+  int i;
+
+  phase = first_phase;
+  start_time = phase_start = last_time = progress_now();
+  if (!path || !*path)
+    return;
+  if (!strcmp(path, "-"))
+    log_fd = 2;
+  else if ((log_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                          0666)) < 0)
+    err(2, "unable to open %s", path);
+  json_escape(stage, sizeof stage, name);
+  for (i = 0; i < argc && len + 1 < sizeof command; i++) {
+    if (i)
+      command[len++] = ' ';
+    json_escape(command + len, sizeof command - len, argv[i]);
+    len += strlen(command + len);
+  }
+  if (pthread_create(&reporter, NULL, report, NULL))
+    errx(2, "unable to create progress thread");
+}
+
+/* Phases are named by string literals, which outlive the records. */
+void progress_phase(const char *name) {
+  char extra[64];
+  pthread_mutex_lock(&lock);
+  snprintf(extra, sizeof extra, ", \"phase_s\": %.3f",
+           progress_now() - phase_start);
+  emit("phase", extra);
+  phase = name;
+  phase_start = progress_now();
+  pthread_mutex_unlock(&lock);
+}
+
+void progress_finish(void) {
+  if (log_fd < 0)
+    return;
+  progress_phase("done");
+  pthread_mutex_lock(&lock);
+  finished = 1;
+  pthread_cond_signal(&wake);
+  pthread_mutex_unlock(&lock);
+  pthread_join(reporter, NULL);
+  pthread_mutex_lock(&lock);
+  emit("done", "");
+  pthread_mutex_unlock(&lock);
+  if (log_fd != 2)
+    close(log_fd);
+  log_fd = -1;
+}
+
+ssize_t progress_read(int fd, void *buf, size_t len) {
+  double t = progress_now();
+  ssize_t n = read(fd, buf, len);
+  add(BLOCKED_IN_NS, (progress_now() - t) * 1e9);
+  if (n > 0)
+    add(BYTES_IN, n);
+  return n;
+}
+
+ssize_t progress_write(int fd, const void *buf, size_t len) {
+  double t = progress_now();
+  ssize_t n = write(fd, buf, len);
+  add(BLOCKED_OUT_NS, (progress_now() - t) * 1e9);
+  if (n > 0)
+    add(BYTES_OUT, n);
+  return n;
+}
+
+void progress_input(size_t bytes, size_t lines, double blocked) {
+  add(BYTES_IN, bytes);
+  add(LINES_IN, lines);
+  add(BLOCKED_IN_NS, blocked * 1e9);
+}
+
+void progress_output(size_t bytes, size_t lines, double blocked) {
+  add(BYTES_OUT, bytes);
+  add(LINES_OUT, lines);
+  add(BLOCKED_OUT_NS, blocked * 1e9);
+}
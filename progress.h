@@ -0,0 +1,36 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Progress records for the stages of the corpus pipeline. If the
+   environment variable ABBRASE_PROGRESS names a file (or "-" for stderr),
+   a stage appends a JSON line to it every PROGRESS_INTERVAL seconds, at
+   each change of phase and when it is done. A record has the bytes and
+   lines read and written so far, the seconds spent blocked in reads and
+   writes, and the peak RSS. progress_report.py summarizes them.
+
+   Counters can be updated from any thread. Blocked time is summed over
+   threads, so a stage reading on several threads can report more of it
+   than has elapsed. */
+
+#define PROGRESS_INTERVAL 5
+
+void progress_start(const char *stage, const char *phase, int argc,
+                    char **argv);
+void progress_phase(const char *phase);
+void progress_finish(void);
+
+/* Read and write, timed and counted as the stage's input and output */
+ssize_t progress_read(int fd, void *buf, size_t len);
+ssize_t progress_write(int fd, const void *buf, size_t len);
+
+/* Count input or output that didn't go through progress_read or
+   progress_write, with the seconds spent blocked on it. */
+void progress_input(size_t bytes, size_t lines, double blocked);
+void progress_output(size_t bytes, size_t lines, double blocked);
+
+double progress_now(void);
+
+#endif
@@ -0,0 +1,84 @@
+#!/usr/bin/env python
+''' summarize the progress records of the corpus pipeline stages
+
+usage: progress_report.py [progress.jsonl]
+
+the stages (groupby, topk, digest) append records to the file named by
+$ABBRASE_PROGRESS. for each command, only its latest run is shown. a stage
+mostly blocked on output is waiting for whatever reads its output (such as
+gzip -9), one mostly blocked on input is waiting for its input (such as
+zcat), and one blocked on neither is bound by its own work.
+'''
+
+from __future__ import print_function
+
+import json
+import sys
+
+# a stage blocked for more than this share of its time is bound by it
+BLOCKED = 0.5
+
+
+def load(path):
+    runs = {}
+    for line in open(path):
+        try:
+            record = json.loads(line)
+        except ValueError:
+            continue   # a record cut short by a killed stage
+        key = (record['stage'], record['command'])
+        run = runs.get(key)
+        if run is None or run['pid'] != record['pid']:
+            # a new run of the command replaces the earlier one
+            run = runs[key] = {'pid': record['pid'], 'phases': [],
+                               'order': len(runs)}
+        run['last'] = record
+        if record['event'] == 'phase':
+            run['phases'].append((record['phase'], record['phase_s']))
+    return sorted(runs.values(), key=lambda run: run['order'])
+
+
+def bound(last):
+    elapsed = last['elapsed_s'] or 1e-9
+    if last['blocked_out_s'] / elapsed > BLOCKED:
+        return 'output'
+    if last['blocked_in_s'] / elapsed > BLOCKED:
+        return 'input'
+    return 'cpu'
+
+
+def report(runs):
+    print('%-8s %9s %9s %9s %11s %9s %7s %7s %8s  %s' % (
+        'stage', 'seconds', 'MB in', 'MB out', 'lines in', 'lines/s',
+        'in blk', 'out blk', 'RSS MB', 'bound by'))
+    for run in runs:
+        last = run['last']
+        elapsed = last['elapsed_s'] or 1e-9
+        state = bound(last)
+        if last['event'] != 'done':
+            state += ' (unfinished)'
+        print('%-8s %9.1f %9.1f %9.1f %11d %9.0f %6.0f%% %6.0f%% %8.1f  %s' % (
+            last['stage'], last['elapsed_s'], last['bytes_in'] / 1e6,
+            last['bytes_out'] / 1e6, last['lines_in'],
+            last['lines_in'] / elapsed, 100 * last['blocked_in_s'] / elapsed,
+            100 * last['blocked_out_s'] / elapsed, last['max_rss_mb'], state))
+        print('         %s' % last['command'])
+        phases = [p for p in run['phases'] if p[0] != 'done']
+        if len(phases) > 1:
+            print('         ' + ', '.join('%s %.1fs' % p for p in phases))
+    if runs:
+        slowest = max(runs, key=lambda run: run['last']['elapsed_s'])
+        last = slowest['last']
+        print('\nthe build is bound by %s (%.1fs), which is bound by %s' % (
+            last['command'], last['elapsed_s'], bound(last)))
+
+
+if __name__ == '__main__':
+    if len(sys.argv) > 2:
+        sys.exit(__doc__)
+    path = sys.argv[1] if len(sys.argv) == 2 else 'data/progress.jsonl'
+    try:
+        runs = load(path)
+    except IOError:
+        sys.exit('no progress records in %s' % path)
+    report(runs)
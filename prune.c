@@ -0,0 +1,269 @@
+/* remove the follower edges that can never change a generated phrase, and
+   write the smaller graph.
+
+   wordgraph_phrase only asks whether a word has any follower in a set of
+   words with the same prefix, and which such follower is preferred: the
+   most frequent one. Say f and g are followers of w with the same prefix,
+   g is preferred to f, and every follower of f is a follower of g. Then g
+   is in every set f is in, so w -> f decides nothing that w -> g doesn't,
+   and w -> f can be dropped. Dropping all such edges at once keeps every
+   set of the backward pass, and so every phrase, the same. That makes the
+   pruned graph a new graph to prune, so this repeats until nothing drops.
+
+   The pruned graph is then loaded back and checked against the original
+   on random prefixes and hook words. */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "wordgraph.h"
+
+#define MAX_CHECK_LEN 8
+
+/* every follower list, back to back */
+struct Lists {
+  size_t *offs;
+  int *data;
+};
+
+struct Pruner {
+  struct WordGraph *g;
+  int *prefix;     /* prefix index of each word */
+  int *preference; /* lower is preferred, as in preferred_word */
+  unsigned *mark;  /* stamp of the last bucket with each word as follower */
+  unsigned stamp;
+};
+
+static void lists_decode(struct WordGraph *g, struct Lists *l) {
+  size_t len = 0, cap = 1 << 20;
+  int i, j;
+  l->offs = malloc((g->n_words + 1) * sizeof l->offs[0]);
+  l->data = malloc(cap * sizeof l->data[0]);
+  for (i = 0; i < g->n_words; i++) {
+    struct IntVec *followers = wordgraph_followers(g, i);
+    if (len + followers->len > cap) {
+      while (len + followers->len > cap)
+        cap *= 2;
+      l->data = realloc(l->data, cap * sizeof l->data[0]);
+    }
+    l->offs[i] = len;
+    for (j = 0; j < followers->len; j++)
+      l->data[len++] = followers->data[j];
+    intvec_free(followers);
+  }
+  l->offs[g->n_words] = len;
+}
+
+static void lists_free(struct Lists *l) {
+  free(l->offs);
+  free(l->data);
+}
+
+static int bucket_cmp(const void *a, const void *b, void *arg) {
+  struct Pruner *p = arg;
+  int x = *(const int *)a, y = *(const int *)b;
+  if (p->prefix[x] != p->prefix[y])
+    return p->prefix[x] - p->prefix[y];
+  return p->preference[x] - p->preference[y];
+}
+
+static int int_cmp(const void *a, const void *b) {
+  return *(const int *)a - *(const int *)b;
+}
+
+/* one round of pruning from cur into next. Returns the edges dropped. */
+static size_t prune_round(struct Pruner *p, struct Lists *cur,
+                          struct Lists *next) {
+  struct WordGraph *g = p->g;
+  size_t dropped = 0, len = 0, k;
+  int *bucket = malloc(g->n_words * sizeof *bucket);
+  int w, i;
+
+  next->offs = malloc((g->n_words + 1) * sizeof next->offs[0]);
+  next->data = malloc((cur->offs[g->n_words] + 1) * sizeof next->data[0]);
+  for (w = 0; w < g->n_words; w++) {
+    int n = cur->offs[w + 1] - cur->offs[w];
+    memcpy(bucket, cur->data + cur->offs[w], n * sizeof *bucket);
+    qsort_r(bucket, n, sizeof *bucket, bucket_cmp, p);
+    next->offs[w] = len;
+    for (i = 0; i < n; i++) {
+      int f = bucket[i];
+      /* followers of the preferred words of this prefix are marked with
+         the bucket's stamp */
+      if (!i || p->prefix[f] != p->prefix[bucket[i - 1]]) {
+        p->stamp++;
+        next->data[len++] = f;
+      } else {
+        for (k = cur->offs[f]; k < cur->offs[f + 1]; k++)
+          if (p->mark[cur->data[k]] != p->stamp)
+            break;
+        if (k == cur->offs[f + 1]) {
+          dropped++;
+          continue;
+        }
+        next->data[len++] = f;
+      }
+      if (i + 1 < n && p->prefix[bucket[i + 1]] == p->prefix[f])
+        for (k = cur->offs[f]; k < cur->offs[f + 1]; k++)
+          p->mark[cur->data[k]] = p->stamp;
+    }
+    qsort(next->data + next->offs[w], len - next->offs[w],
+          sizeof next->data[0], int_cmp);
+  }
+  next->offs[g->n_words] = len;
+  free(bucket);
+  return dropped;
+}
+
+static void write_graph(struct WordGraph *g, struct Lists *l,
+                        const char *path, size_t *bytes) {
+  FILE *out = fopen(path, "w");
+  int i;
+  if (!out)
+    err(1, "unable to create %s", path);
+  fprintf(out, "%d\n", g->n_words);
+  for (i = 1; i < g->n_words; i++)
+    fprintf(out, "%s\n", g->words[i]);
+  *bytes = 0;
+  for (i = 0; i < g->n_words; i++) {
+    char *enc = encode(l->data + l->offs[i], l->offs[i + 1] - l->offs[i]);
+    *bytes += strlen(enc);
+    fprintf(out, "%s\n", enc);
+    free(enc);
+  }
+  if (g->rank) {
+    fputs("#ranks\n", out);
+    for (i = 1; i < g->n_words; i++) {
+      unsigned r = g->rank[i];
+      do {
+        fputc((r < 0x20 ? 0x40 : 0x20) | (r & 0x1f), out);
+        r >>= 5;
+      } while (r);
+    }
+    fputc('\n', out);
+  }
+  if (fclose(out))
+    err(1, "unable to write %s", path);
+}
+
+/* deterministic for a seed, so a failure can be reproduced */
+static uint64_t rng_next(uint64_t *state) {
+  uint64_t x = (*state += 0x9e3779b97f4a7c15ULL);
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/* compare phrases from both graphs. Returns the number that differ. */
+static long verify(struct WordGraph *a, struct WordGraph *b, long n,
+                   uint64_t seed) {
+  int prefixes[MAX_CHECK_LEN], words_a[MAX_CHECK_LEN], words_b[MAX_CHECK_LEN];
+  long i, differ = 0;
+  for (i = 0; i < n; i++) {
+    int length = 1 + rng_next(&seed) % MAX_CHECK_LEN, j;
+    /* half the phrases start from a random hook word */
+    int start = rng_next(&seed) & 1 ? rng_next(&seed) % a->n_words : 0;
+    for (j = 0; j < length; j++)
+      prefixes[j] = rng_next(&seed) % a->n_prefixes;
+    int mismatch_a = wordgraph_phrase(a, prefixes, length, start, words_a);
+    int mismatch_b = wordgraph_phrase(b, prefixes, length, start, words_b);
+    if (mismatch_a != mismatch_b ||
+        memcmp(words_a, words_b, length * sizeof words_a[0])) {
+      if (!differ++)
+        for (j = 0; j < length; j++)
+          fprintf(stderr, "differs: %.3s -> %s / %s\n",
+                  a->prefixes[prefixes[j]].prefix, a->words[words_a[j]],
+                  b->words[words_b[j]]);
+    }
+  }
+  return differ;
+}
+
+static void usage(const char *name) {
+  errx(1, "usage: %s [-v N] [-s SEED] <graph> <pruned graph>\n"
+       "  -v N     check N random phrases against the original graph,\n"
+       "           default 100000\n"
+       "  -s SEED  seed for the random phrases, default the time",
+       name);
+}
+
+int main(int argc, char *argv[]) {
+  long checks = 100000;
+  uint64_t seed = time(NULL);
+  const char *in = NULL, *out = NULL;
+  int i, j;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-v") && i + 1 < argc)
+      checks = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+      seed = strtoull(argv[++i], NULL, 10);
+    else if (!in)
+      in = argv[i];
+    else if (!out)
+      out = argv[i];
+    else
+      usage(argv[0]);
+  }
+  if (!out)
+    usage(argv[0]);
+
+  struct WordGraph *g = wordgraph_init(in);
+  struct Pruner p;
+  struct Lists cur, next;
+  p.g = g;
+  p.prefix = malloc(g->n_words * sizeof p.prefix[0]);
+  p.preference = malloc(g->n_words * sizeof p.preference[0]);
+  p.mark = calloc(g->n_words, sizeof p.mark[0]);
+  p.stamp = 0;
+  p.prefix[0] = -1;
+  for (i = 0; i < g->n_prefixes; i++)
+    for (j = 0; j < g->prefixes[i].words->len; j++)
+      p.prefix[g->prefixes[i].words->data[j]] = i;
+  for (i = 0; i < g->n_words; i++)
+    p.preference[i] = g->rank ? g->rank[i] : i;
+
+  lists_decode(g, &cur);
+  size_t edges = cur.offs[g->n_words], dropped, bytes_before = 0, bytes_after;
+  for (i = 0; i < g->n_words; i++) {
+    char *enc = encode(cur.data + cur.offs[i], cur.offs[i + 1] - cur.offs[i]);
+    bytes_before += strlen(enc);
+    free(enc);
+  }
+  int round = 0;
+  do {
+    dropped = prune_round(&p, &cur, &next);
+    lists_free(&cur);
+    cur = next;
+    fprintf(stderr, "round %d: dropped %zu edges\n", ++round, dropped);
+  } while (dropped);
+
+  write_graph(g, &cur, out, &bytes_after);
+  fprintf(stderr, "edges: %zu -> %zu (%+.1f%%)\n", edges, cur.offs[g->n_words],
+          100.0 * cur.offs[g->n_words] / edges - 100);
+  fprintf(stderr, "follower lists: %zu -> %zu bytes (%+.1f%%)\n", bytes_before,
+          bytes_after, 100.0 * bytes_after / bytes_before - 100);
+
+  if (checks) {
+    struct WordGraph *pruned = wordgraph_init(out);
+    long differ = verify(g, pruned, checks, seed);
+    fprintf(stderr, "checked %ld phrases with seed %llu: %ld differ\n", checks,
+            (unsigned long long)seed, differ);
+    wordgraph_free(pruned);
+    if (differ)
+      errx(3, "%s doesn't generate the same phrases as %s", out, in);
+  }
+  lists_free(&cur);
+  wordgraph_free(g);
+  free(p.prefix);
+  free(p.preference);
+  free(p.mark);
+  return 0;
+}
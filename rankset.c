@@ -0,0 +1,84 @@
+#include <err.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "rankset.h"
+
+#define EMPTY UINT64_MAX
+
+/* the set is kept at most 80% full, which costs 10 bytes per rank.
+   Capacities aren't powers of two, so slots are picked by scaling the hash
+   into [0, cap) instead of masking it. */
+#define MAX_LOAD_NUM 4
+#define MAX_LOAD_DEN 5
+
+static size_t rankset_slot(struct RankSet *set, uint64_t rank) {
+  /* splitmix64 finalizer: ranks from a ledger needn't be well distributed */
+  rank ^= rank >> 30;
+  rank *= 0xbf58476d1ce4e5b9ULL;
+  rank ^= rank >> 27;
+  rank *= 0x94d049bb133111ebULL;
+  rank ^= rank >> 31;
+  return (unsigned __int128)rank * set->cap >> 64;
+}
+
+static void rankset_resize(struct RankSet *set, size_t cap) {
+  uint64_t *old = set->slots;
+  size_t old_cap = set->cap, i;
+  set->cap = cap;
+  set->slots = malloc(sizeof(uint64_t) * cap);
+  if (!set->slots)
+    err(8, "unable to allocate %zu byte rank set", sizeof(uint64_t) * cap);
+  for (i = 0; i < cap; i++)
+    set->slots[i] = EMPTY;
+  set->len = 0;
+  for (i = 0; i < old_cap; i++)
+    if (old[i] != EMPTY)
+      rankset_insert(set, old[i]);
+  free(old);
+}
+
+struct RankSet *rankset_alloc(size_t expected) {
+  struct RankSet *set = malloc(sizeof *set);
+  set->len = 0;
+  set->cap = 0;
+  set->slots = NULL;
+  rankset_resize(set, expected * MAX_LOAD_DEN / MAX_LOAD_NUM + 16);
+  return set;
+}
+
+void rankset_free(struct RankSet *set) {
+  free(set->slots);
+  free(set);
+}
+
+/* add a rank to the set. Returns 1 if it was new, 0 if already present. */
+int rankset_insert(struct RankSet *set, uint64_t rank) {
+  if ((set->len + 1) * MAX_LOAD_DEN > set->cap * MAX_LOAD_NUM)
+    rankset_resize(set, set->cap * 2);
+  size_t i = rankset_slot(set, rank);
+  while (set->slots[i] != EMPTY) {
+    if (set->slots[i] == rank)
+      return 0;
+    if (++i == set->cap)
+      i = 0;
+  }
+  set->slots[i] = rank;
+  set->len++;
+  return 1;
+}
+
+int rankset_contains(struct RankSet *set, uint64_t rank) {
+  size_t i = rankset_slot(set, rank);
+  while (set->slots[i] != EMPTY) {
+    if (set->slots[i] == rank)
+      return 1;
+    if (++i == set->cap)
+      i = 0;
+  }
+  return 0;
+}
+
+size_t rankset_bytes(struct RankSet *set) {
+  return sizeof *set + sizeof(uint64_t) * set->cap;
+}
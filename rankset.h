@@ -0,0 +1,21 @@
+#ifndef RANKSET_H
+#define RANKSET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* an open addressing hash set of password ranks (see wordgraph_rank).
+   UINT64_MAX is never a valid rank, and marks empty slots. */
+struct RankSet {
+  size_t len;
+  size_t cap;
+  uint64_t *slots;
+};
+
+struct RankSet *rankset_alloc(size_t expected);
+void rankset_free(struct RankSet *set);
+int rankset_insert(struct RankSet *set, uint64_t rank);
+int rankset_contains(struct RankSet *set, uint64_t rank);
+size_t rankset_bytes(struct RankSet *set);
+
+#endif
@@ -0,0 +1,82 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "stats.h"
+
+#ifdef ABBRASE_STATS
+
+__thread struct Stats thread_stats;
+
+static struct Stats total;
+static pthread_mutex_t total_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* when the program started, in ticks and seconds, to calibrate ticks */
+static uint64_t start_ticks;
+static double start_seconds;
+
+static double seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+__attribute__((constructor)) static void stats_start() {
+  start_ticks = stats_ticks();
+  start_seconds = seconds();
+}
+
+/* add this thread's counters to the totals */
+void stats_flush() {
+  uint64_t *from = (uint64_t *)&thread_stats, *to = (uint64_t *)&total;
+  size_t i;
+  pthread_mutex_lock(&total_lock);
+  for (i = 0; i < sizeof total / sizeof(uint64_t); i++) {
+    to[i] += from[i];
+    from[i] = 0;
+  }
+  pthread_mutex_unlock(&total_lock);
+}
+
+void stats_print(FILE *out) {
+  struct rusage usage;
+  stats_flush();
+  double per_tick =
+      (seconds() - start_seconds) / (double)(stats_ticks() - start_ticks);
+#define TIME(field) (total.field * per_tick)
+  fprintf(out, "wordgraph_init:    %9.3f s\n",
+          TIME(init_words_ticks) + TIME(init_prefixes_ticks) +
+              TIME(init_followers_ticks));
+  fprintf(out, "  word parse:      %9.3f s\n", TIME(init_words_ticks));
+  fprintf(out, "  prefix grouping: %9.3f s\n", TIME(init_prefixes_ticks));
+  fprintf(out, "  follower read:   %9.3f s\n", TIME(init_followers_ticks));
+  fprintf(out, "backward pass:     %9.3f s (all threads)\n",
+          TIME(backward_ticks));
+  fprintf(out, "forward pass:      %9.3f s (all threads)\n",
+          TIME(forward_ticks));
+#undef TIME
+  fprintf(out, "phrases:           %9llu\n", (unsigned long long)total.phrases);
+  fprintf(out, "mismatches:        %9llu\n",
+          (unsigned long long)total.mismatches);
+  fprintf(out, "decode calls:      %9llu (%llu bytes, %llu ints)\n",
+          (unsigned long long)total.decode_calls,
+          (unsigned long long)total.decode_bytes,
+          (unsigned long long)total.decode_ints);
+  fprintf(out, "intersect calls:   %9llu (%llu elements scanned)\n",
+          (unsigned long long)total.intersect_calls,
+          (unsigned long long)total.intersect_scanned);
+  if (!getrusage(RUSAGE_SELF, &usage))
+    fprintf(out, "peak RSS:          %9.1f MB\n", usage.ru_maxrss / 1024.0);
+}
+
+#else
+
+void stats_flush() {}
+
+void stats_print(FILE *out) {
+  fprintf(out, "abbrase was built without stats (ABBRASE_STATS)\n");
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Per-phase timers and counters for --stats. Building without
+   ABBRASE_STATS compiles all of it out of the hot paths.
+
+   Counters are kept per thread, and threads add theirs to the totals with
+   stats_flush when they finish. Timers count CPU timestamp ticks where
+   available, which stats_print converts to seconds. */
+
+struct Stats {
+  uint64_t init_words_ticks;     /* reading the word list */
+  uint64_t init_prefixes_ticks;  /* grouping words by prefix */
+  uint64_t init_followers_ticks; /* reading follower lists */
+  uint64_t backward_ticks;
+  uint64_t forward_ticks;
+  uint64_t decode_calls;
+  uint64_t decode_bytes;
+  uint64_t decode_ints;
+  uint64_t intersect_calls;
+  uint64_t intersect_scanned;
+  uint64_t phrases;
+  uint64_t mismatches;
+};
+
+#ifdef ABBRASE_STATS
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t stats_ticks() { return __rdtsc(); }
+#else
+#include <time.h>
+static inline uint64_t stats_ticks() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+extern __thread struct Stats thread_stats;
+
+#define STATS_ADD(field, n) (thread_stats.field += (n))
+#define STATS_START(var) uint64_t var = stats_ticks()
+#define STATS_STOP(field, var) (thread_stats.field += stats_ticks() - (var))
+
+#else
+
+#define STATS_ADD(field, n) ((void)0)
+#define STATS_START(var) ((void)0)
+#define STATS_STOP(field, var) ((void)0)
+
+#endif
+
+void stats_flush();
+void stats_print(FILE *out);
+
+#endif
@@ -0,0 +1,266 @@
+/* print the k lines with the largest counts in their second field, in the
+order of LC_ALL=C sort -rgk2 | head -n k: by count, then by the line bytes,
+both descending.
+
+with -p, first sum the count in the last field of each line by the line's
+first three characters, skipping lines that don't start with [a-z]{3}, and
+select among the prefixes instead.
+
+lines are kept in a heap of the k best so far, so this is one pass over the
+input in O(k) memory. */
+
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "progress.h"
+
+#define BLOCK_SIZE (4 << 20)
+#define N_PREFIXES (26 * 26 * 26)
+
+struct Line {
+    char *text;
+    size_t len, cap;
+    int has_count;
+    double count;
+};
+
+struct TopK {
+    struct Line *heap;  /* the worst of the k best lines is at the top */
+    size_t n, k;
+};
+
+/* parse a count the way sort -g does, returning 0 if there isn't one */
+static int parse_count(const char *p, const char *end, double *count) {
+    long long v = 0;
+    int neg = 0;
+    const char *digits;
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+    digits = p;
+    while (p < end && (unsigned)(*p - '0') < 10 && p - digits < 18)
+        v = v * 10 + (*p++ - '0');
+    if (p == digits)
+        return 0;
+    if (p < end && (*p == '.' || *p == 'e' || *p == 'E' ||
+                    (unsigned)(*p - '0') < 10)) {
+        /* not a plain integer, so leave it to strtod */
+        char buf[64];
+        size_t len = end - digits < 63 ? end - digits : 63;
+        memcpy(buf, digits, len);
+        buf[len] = 0;
+        *count = strtod(buf, NULL);
+    } else {
+        *count = v;
+    }
+    if (neg)
+        *count = -*count;
+    return 1;
+}
+
+/* compare like sort -g, then by the bytes of the whole line */
+static int line_cmp(const char *a, size_t a_len, int a_has, double a_count,
+                    const struct Line *b) {
+    if (a_has != b->has_count)
+        return a_has - b->has_count;
+    if (a_has && a_count != b->count)
+        return a_count < b->count ? -1 : 1;
+    size_t n = a_len < b->len ? a_len : b->len;
+    int c = memcmp(a, b->text, n);
+    if (c)
+        return c;
+    return a_len < b->len ? -1 : a_len > b->len;
+}
+
+static int heap_less(const struct Line *a, const struct Line *b) {
+    return line_cmp(a->text, a->len, a->has_count, a->count, b) < 0;
+}
+
+static void heap_down(struct TopK *t, size_t i) {
+    for (;;) {
+        size_t min = i, l = 2 * i + 1, r = l + 1;
+        if (l < t->n && heap_less(&t->heap[l], &t->heap[min]))
+            min = l;
+        if (r < t->n && heap_less(&t->heap[r], &t->heap[min]))
+            min = r;
+        if (min == i)
+            return;
+        struct Line tmp = t->heap[i];
+        t->heap[i] = t->heap[min];
+        t->heap[min] = tmp;
+        i = min;
+    }
+}
+
+static void heap_up(struct TopK *t, size_t i) {
+    while (i && heap_less(&t->heap[i], &t->heap[(i - 1) / 2])) {
+        struct Line tmp = t->heap[i];
+        t->heap[i] = t->heap[(i - 1) / 2];
+        t->heap[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+}
+
+static void line_set(struct Line *l, const char *text, size_t len,
+                     int has_count, double count) {
+    if (len > l->cap) {
+        l->cap = len * 2;
+        if (!(l->text = realloc(l->text, l->cap)))
+            err(2, "unable to allocate line");
+    }
+    memcpy(l->text, text, len);
+    l->len = len;
+    l->has_count = has_count;
+    l->count = count;
+}
+
+static void topk_add(struct TopK *t, const char *text, size_t len,
+                     int has_count, double count) {
+    if (t->n < t->k) {
+        line_set(&t->heap[t->n], text, len, has_count, count);
+        heap_up(t, t->n++);
+    } else if (t->k && line_cmp(text, len, has_count, count, &t->heap[0]) > 0) {
+        line_set(&t->heap[0], text, len, has_count, count);
+        heap_down(t, 0);
+    }
+}
+
+/* the second field starts at the blanks ending the first, as in sort -k2 */
+static void topk_line(struct TopK *t, const char *line, const char *end) {
+    const char *p = line;
+    double count = 0;
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    while (p < end && *p != ' ' && *p != '\t')
+        p++;
+    int has_count = parse_count(p, end, &count);
+    topk_add(t, line, end - line, has_count, count);
+}
+
+/* parse an integer count the way groupby does */
+static long long parse_total(const char *p, const char *end) {
+    long long v = 0;
+    int neg = 0;
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+    while (p < end && (unsigned)(*p - '0') < 10)
+        v = v * 10 + (*p++ - '0');
+    return neg ? -v : v;
+}
+
+static void prefix_line(long long *totals, const char *line, const char *end) {
+    const char *tab;
+    int i, index = 0;
+    if (end - line < 4)
+        return;
+    for (i = 0; i < 3; i++) {
+        if (line[i] < 'a' || line[i] > 'z')
+            return;
+        index = index * 26 + line[i] - 'a';
+    }
+    for (tab = end - 1; tab >= line + 3 && *tab != '\t'; tab--)
+        ;
+    if (tab < line + 3)
+        return;
+    totals[index] += parse_total(tab + 1, end);
+}
+
+static int best_first(const void *a, const void *b) {
+    return heap_less(a, b) - heap_less(b, a);
+}
+
+static void usage(const char *name) {
+    errx(1, "usage: %s [-p] <k>\n"
+         "  -p  select among the three-letter prefixes of the lines, with\n"
+         "      the counts in their last field summed", name);
+}
+
+int main(int argc, char *argv[]) {
+    struct TopK t = {NULL, 0, 0};
+    long long *totals = NULL;
+    int opt, prefixes = 0;
+    long k;
+
+    while ((opt = getopt(argc, argv, "p")) != -1) {
+        if (opt != 'p')
+            usage(argv[0]);
+        prefixes = 1;
+    }
+    if (argc - optind != 1 || (k = atol(argv[optind])) < 0)
+        usage(argv[0]);
+    t.k = k;
+    if (!(t.heap = calloc(k ? k : 1, sizeof(*t.heap))))
+        err(2, "unable to allocate %ld lines", k);
+    if (prefixes)
+        totals = calloc(N_PREFIXES, sizeof(*totals));
+    progress_start("topk", "read", argc, argv);
+
+    size_t cap = BLOCK_SIZE, len = 0;
+    char *buf = malloc(cap);
+    ssize_t n;
+    while ((n = progress_read(0, buf + len, cap - len)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            err(2, "read failed");
+        }
+        len += n;
+        char *line = buf, *end = buf + len, *nl;
+        size_t lines;
+        for (lines = 0; (nl = memchr(line, '\n', end - line)); lines++) {
+            if (prefixes)
+                prefix_line(totals, line, nl);
+            else
+                topk_line(&t, line, nl);
+            line = nl + 1;
+        }
+        progress_input(0, lines, 0);
+        /* keep the partial last line, growing the buffer for long ones */
+        len = end - line;
+        memmove(buf, line, len);
+        if (len == cap)
+            buf = realloc(buf, cap *= 2);
+    }
+    if (len) {
+        if (prefixes)
+            prefix_line(totals, buf, buf + len);
+        else
+            topk_line(&t, buf, buf + len);
+        progress_input(0, 1, 0);
+    }
+
+    if (prefixes) {
+        int i;
+        for (i = 0; i < N_PREFIXES; i++) {
+            char line[32];
+            if (!totals[i])
+                continue;
+            int line_len = snprintf(line, sizeof(line), "%c%c%c\t%lld",
+                                    'a' + i / 676, 'a' + i / 26 % 26,
+                                    'a' + i % 26, totals[i]);
+            topk_add(&t, line, line_len, 1, totals[i]);
+        }
+    }
+
+    qsort(t.heap, t.n, sizeof(*t.heap), best_first);
+    progress_phase("write");
+    double start = progress_now();
+    size_t bytes = 0;
+    for (size_t i = 0; i < t.n; i++) {
+        fwrite(t.heap[i].text, 1, t.heap[i].len, stdout);
+        putchar('\n');
+        bytes += t.heap[i].len + 1;
+    }
+    if (fflush(stdout))
+        err(2, "write failed");
+    progress_output(bytes, t.n, progress_now() - start);
+    progress_finish();
+    return 0;
+}
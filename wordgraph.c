@@ -0,0 +1,1187 @@
+#include <ctype.h>
+#include <err.h>
+#include <limits.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "blockcode.h"
+#include "crc32c.h"
+#include "eliasfano.h"
+#include "perf.h"
+#include "stats.h"
+#include "wordgraph.h"
+
+struct IntVec *intvec_alloc() {
+  struct IntVec *vec = malloc(sizeof *vec);
+  vec->len = 0;
+  vec->cap = 1;
+  vec->data = malloc(sizeof(int) * vec->cap);
+  return vec;
+}
+
+void intvec_free(struct IntVec *vec) {
+  free(vec->data);
+  free(vec);
+}
+
+void intvec_append(struct IntVec *vec, int val) {
+  if (vec->len == vec->cap) {
+    vec->cap *= 2;
+    vec->data = realloc(vec->data, sizeof(int) * vec->cap);
+  }
+  vec->data[vec->len++] = val;
+}
+
+int intvec_get(struct IntVec *vec, int pos) {
+  if (pos < 0 || pos >= vec->len)
+    err(10, "invalid vector index %d not in [0, %d)", pos, vec->len);
+  return vec->data[pos];
+}
+
+struct IntVec *intvec_copy(struct IntVec *vec) {
+  /* could be faster, but no need to optimize */
+  struct IntVec *ret = intvec_alloc();
+  int i;
+  for (i = 0; i < vec->len; i++)
+    intvec_append(ret, vec->data[i]);
+  return ret;
+}
+
+void intvec_print(struct IntVec *vec) {
+  int i;
+  printf("[");
+  for (i = 0; i < vec->len; i++) {
+    if (i != 0)
+      printf(", ");
+    printf("%d", vec->data[i]);
+  }
+  printf("]");
+}
+
+/* return a new IntVec with the elements in common between a and b.
+   Requires a and b to be sorted. */
+struct IntVec *intvec_intersect(struct IntVec *a, struct IntVec *b) {
+  struct IntVec *ret = intvec_alloc();
+  int ai = 0, bi = 0;
+  while (ai < a->len && bi < b->len) {
+    int diff = a->data[ai] - b->data[bi];
+    if (diff == 0) {
+      intvec_append(ret, a->data[ai]);
+      ai++, bi++;
+    } else if (diff < 0) {
+      ai++;
+    } else if (diff > 0) {
+      bi++;
+    }
+  }
+  STATS_ADD(intersect_calls, 1);
+  STATS_ADD(intersect_scanned, ai + bi);
+  return ret;
+}
+
+void getline_trimmed(char **target, FILE *stream) {
+  size_t n, len;
+  n = 0;
+  *target = NULL;
+  if (getline(target, &n, stream) == -1)
+    err(1, "corrupted wordgraph file");
+  len = strlen(*target);
+  if ((*target)[len - 1] == '\n')
+    (*target)[len - 1] = 0;
+}
+
+/* return the index of a prefix, or -1 if it isn't in the graph */
+int wordgraph_prefix_index(struct WordGraph *g, const char *prefix) {
+  int i = g->prefix_table[PREFIX_KEY(prefix)] - 1;
+  if (i >= 0 && !memcmp(g->prefixes[i].prefix, prefix, PREFIX_LEN))
+    return i;
+  /* non-letters can alias in the table, fall back to a scan */
+  for (i = 0; i < g->n_prefixes; i++)
+    if (!memcmp(g->prefixes[i].prefix, prefix, PREFIX_LEN))
+      return i;
+  return -1;
+}
+
+/* read the optional rank section: the frequency rank of each word as
+   printable base-32 varints, present when digest -r renumbered the words */
+static void read_ranks(struct WordGraph *g, FILE *graph_file) {
+  char *line = NULL;
+  size_t n = 0;
+  int i, pos = 0;
+  g->rank = NULL;
+  if (getline(&line, &n, graph_file) == -1 || strcmp(line, "#ranks\n")) {
+    free(line);
+    return;
+  }
+  free(line);
+  getline_trimmed(&line, graph_file);
+  g->rank = calloc(g->n_words, sizeof g->rank[0]);
+  for (i = 1; i < g->n_words; i++) {
+    int shift = 0;
+    unsigned char val;
+    do {
+      val = line[pos++];
+      if (val < 0x20 || val >= 0x60)
+        errx(3, "corrupted wordgraph file: bad rank");
+      g->rank[i] |= (val & 0x1f) << shift;
+      shift += 5;
+    } while (!(val & 0x40));
+  }
+  free(line);
+}
+
+static void read_text(struct WordGraph *g, FILE *graph_file) {
+  int i;
+  if (fscanf(graph_file, "%d ", &g->n_words) != 1)
+    err(1, "corrupted wordgraph file");
+  g->words = calloc(g->n_words, sizeof g->words[0]);
+  g->followers_compressed = calloc(g->n_words, sizeof g->words[0]);
+  STATS_START(words_start);
+  for (i = 1; i < g->n_words; i++)
+    getline_trimmed(&g->words[i], graph_file);
+  STATS_STOP(init_words_ticks, words_start);
+  STATS_START(followers_start);
+  for (i = 0; i < g->n_words; i++)
+    getline_trimmed(&g->followers_compressed[i], graph_file);
+  STATS_STOP(init_followers_ticks, followers_start);
+  read_ranks(g, graph_file);
+}
+
+static const struct GraphSection *find_section(const struct GraphHeader *h,
+                                               uint32_t type) {
+  const struct GraphSection *sections = (const void *)(h + 1);
+  uint32_t i;
+  for (i = 0; i < h->n_sections; i++)
+    if (sections[i].type == type)
+      return &sections[i];
+  return NULL;
+}
+
+/* point strings at the NUL-terminated strings of a section, checking that
+   each one ends before the next begins */
+static char **map_strings(struct WordGraph *g, const struct GraphHeader *h,
+                          uint32_t type, uint32_t offs_type) {
+  const struct GraphSection *data = find_section(h, type);
+  const struct GraphSection *offs = find_section(h, offs_type);
+  char **strings;
+  int i;
+  if (!data || !offs || offs->length != (g->n_words + 1) * sizeof(uint64_t))
+    errx(3, "corrupted wordgraph file: missing section %u", type);
+  const char *base = (const char *)g->map + data->offset;
+  const uint64_t *off = (const void *)((const char *)g->map + offs->offset);
+  if (off[0] != 0 || off[g->n_words] != data->length)
+    errx(3, "corrupted wordgraph file: bad offsets in section %u", type);
+  strings = malloc(g->n_words * sizeof strings[0]);
+  for (i = 0; i < g->n_words; i++) {
+    if (off[i + 1] <= off[i] || off[i + 1] > data->length ||
+        base[off[i + 1] - 1])
+      errx(3, "corrupted wordgraph file: bad offsets in section %u", type);
+    strings[i] = (char *)base + off[i];
+  }
+  return strings;
+}
+
+/* point blocks at the block coded lists of a section, checking that they
+   are in order and followed by the padding */
+static uint8_t **map_blocks(struct WordGraph *g, const struct GraphHeader *h) {
+  const struct GraphSection *data = find_section(h, GRAPH_BLOCKS);
+  const struct GraphSection *offs = find_section(h, GRAPH_BLOCK_OFFS);
+  uint8_t **blocks;
+  int i;
+  if (!offs || offs->length != (g->n_words + 1) * sizeof(uint64_t))
+    errx(3, "corrupted wordgraph file: missing section %u", GRAPH_BLOCK_OFFS);
+  uint8_t *base = (uint8_t *)g->map + data->offset;
+  const uint64_t *off = (const void *)((const char *)g->map + offs->offset);
+  if (off[0] != 0 || off[g->n_words] + BLOCK_PAD != data->length)
+    errx(3, "corrupted wordgraph file: bad offsets in section %u",
+         GRAPH_BLOCKS);
+  blocks = malloc((g->n_words + 1) * sizeof blocks[0]);
+  for (i = 0; i < g->n_words; i++) {
+    if (off[i + 1] < off[i] + 4 || off[i + 1] > off[g->n_words])
+      errx(3, "corrupted wordgraph file: bad offsets in section %u",
+           GRAPH_BLOCKS);
+    blocks[i] = base + off[i];
+  }
+  blocks[g->n_words] = base + off[g->n_words];
+  return blocks;
+}
+
+/* point skips at the skip tables of the follower lists if the graph has
+   them, checking that each word's entries are within the section. The
+   entries themselves are checked by validation. */
+static void map_skips(struct WordGraph *g, const struct GraphHeader *h) {
+  const struct GraphSection *data = find_section(h, GRAPH_SKIPS);
+  const struct GraphSection *offs = find_section(h, GRAPH_SKIP_OFFS);
+  int i;
+  if (!data)
+    return;
+  if (!offs || offs->length != (g->n_words + 1) * sizeof(uint64_t))
+    errx(3, "corrupted wordgraph file: missing section %u", GRAPH_SKIP_OFFS);
+  const uint64_t *off = (const void *)((const char *)g->map + offs->offset);
+  if (off[0] != 0 || off[g->n_words] * sizeof(struct SkipEntry) !=
+                         data->length)
+    errx(3, "corrupted wordgraph file: bad offsets in section %u",
+         GRAPH_SKIPS);
+  for (i = 0; i < g->n_words; i++)
+    if (off[i + 1] < off[i])
+      errx(3, "corrupted wordgraph file: bad offsets in section %u",
+           GRAPH_SKIPS);
+  g->skips = (const void *)((const char *)g->map + data->offset);
+  g->skip_offs = off;
+}
+
+/* map a binary graph, checking the section checksums */
+static void map_binary(struct WordGraph *g, FILE *graph_file) {
+  struct GraphHeader header;
+  struct stat st;
+  uint32_t i;
+
+  if (fstat(fileno(graph_file), &st) || st.st_size < (off_t)sizeof header)
+    errx(3, "corrupted wordgraph file: truncated header");
+  g->map_len = st.st_size;
+  g->map = mmap(NULL, g->map_len, PROT_READ, MAP_PRIVATE, fileno(graph_file),
+                0);
+  if (g->map == MAP_FAILED)
+    err(1, "unable to map wordgraph file");
+  memcpy(&header, g->map, sizeof header);
+  size_t table_len = (size_t)header.n_sections * sizeof(struct GraphSection);
+  if (header.n_sections > 64 || sizeof header + table_len > g->map_len)
+    errx(3, "corrupted wordgraph file: truncated section table");
+  uint32_t crc = header.crc;
+  header.crc = 0;
+  if (crc != crc32c(crc32c(0, &header, sizeof header),
+                    (const char *)g->map + sizeof header, table_len))
+    errx(3, "corrupted wordgraph file: bad header checksum");
+
+  const struct GraphSection *sections = (const void *)((char *)g->map +
+                                                       sizeof header);
+  for (i = 0; i < header.n_sections; i++) {
+    if (sections[i].offset % 8 || sections[i].offset > g->map_len ||
+        sections[i].length > g->map_len - sections[i].offset)
+      errx(3, "corrupted wordgraph file: section %u out of bounds",
+           sections[i].type);
+    if (crc32c(0, (const char *)g->map + sections[i].offset,
+               sections[i].length) != sections[i].crc)
+      errx(3, "corrupted wordgraph file: bad checksum in section %u",
+           sections[i].type);
+  }
+
+  if (header.n_words == 0 || header.n_words > INT_MAX)
+    errx(3, "corrupted wordgraph file: bad word count %u", header.n_words);
+  g->n_words = header.n_words;
+  STATS_START(words_start);
+  g->words = map_strings(g, g->map, GRAPH_WORDS, GRAPH_WORD_OFFS);
+  STATS_STOP(init_words_ticks, words_start);
+  STATS_START(followers_start);
+  if (find_section(g->map, GRAPH_BLOCKS))
+    g->blocks = map_blocks(g, g->map);
+  else
+    g->followers_compressed = map_strings(g, g->map, GRAPH_FOLLOWERS,
+                                          GRAPH_FOLLOWER_OFFS);
+  if (g->followers_compressed)
+    map_skips(g, g->map);
+  STATS_STOP(init_followers_ticks, followers_start);
+  const struct GraphSection *ranks = find_section(g->map, GRAPH_RANKS);
+  if (ranks) {
+    if (ranks->length != g->n_words * sizeof(uint32_t))
+      errx(3, "corrupted wordgraph file: bad rank section");
+    g->rank = malloc(g->n_words * sizeof g->rank[0]);
+    memcpy(g->rank, (char *)g->map + ranks->offset, ranks->length);
+  }
+  g->validated = header.flags & GRAPH_VALIDATED;
+}
+
+struct WordGraph *wordgraph_init(const char *filename) {
+  int i, j;
+  char magic[sizeof GRAPH_MAGIC - 1];
+  PERF_BEGIN(PERF_LOAD);
+  FILE *graph_file = fopen(filename, "r");
+  if (!graph_file)
+    err(1, "unable to open %s", filename);
+  struct WordGraph *g = calloc(1, sizeof *g);
+  if (fread(magic, 1, sizeof magic, graph_file) == sizeof magic &&
+      !memcmp(magic, GRAPH_MAGIC, sizeof magic)) {
+    map_binary(g, graph_file);
+  } else {
+    rewind(graph_file);
+    read_text(g, graph_file);
+  }
+  fclose(graph_file);
+
+  /* prefixes are numbered in order of first use by the most frequent
+     words, and list their words in order of word number */
+  STATS_START(prefixes_start);
+  int *word_prefix = malloc(g->n_words * sizeof *word_prefix);
+  int *by_rank = wordgraph_words_by_rank(g);
+  for (i = 1; i < g->n_words; i++) {
+    int word = by_rank[i];
+    /* extract lowercase prefix */
+    char prefix[PREFIX_LEN];
+    for (j = 0; j < PREFIX_LEN; j++)
+        prefix[j] = tolower(g->words[word][j]);
+    j = wordgraph_prefix_index(g, prefix);
+    if (j < 0) {
+      /* none found, need to insert */
+      if (g->n_prefixes == MAX_PREFIXES)
+        errx(2, "corrupted wordgraph file: too many prefixes");
+      j = g->n_prefixes++;
+      memcpy(g->prefixes[j].prefix, prefix, PREFIX_LEN);
+      g->prefixes[j].words = intvec_alloc();
+      if (!g->prefix_table[PREFIX_KEY(prefix)])
+        g->prefix_table[PREFIX_KEY(prefix)] = j + 1;
+    }
+    word_prefix[word] = j;
+  }
+  for (i = 1; i < g->n_words; i++)
+    intvec_append(g->prefixes[word_prefix[i]].words, i);
+  free(by_rank);
+  free(word_prefix);
+  STATS_STOP(init_prefixes_ticks, prefixes_start);
+  if (g->n_prefixes != MAX_PREFIXES)
+    errx(3, "corrupted wordgraph file: not enough prefixes");
+  PERF_END(PERF_LOAD);
+  return g;
+}
+
+/* return a new array of the words from most to least frequent, with 0 first */
+int *wordgraph_words_by_rank(struct WordGraph *g) {
+  int *by_rank = malloc(g->n_words * sizeof *by_rank), i;
+  for (i = 0; i < g->n_words; i++)
+    by_rank[g->rank ? g->rank[i] : i] = i;
+  return by_rank;
+}
+
+/* the most frequent word in a non-empty set */
+static int preferred_word(struct WordGraph *g, struct IntVec *words) {
+  int i, best = intvec_get(words, 0);
+  if (g->rank)
+    for (i = 1; i < words->len; i++)
+      if (g->rank[words->data[i]] < g->rank[best])
+        best = words->data[i];
+  return best;
+}
+
+void wordgraph_free(struct WordGraph *g) {
+  int i;
+  for (i = 0; i < g->n_words && !g->map; i++) {
+    free(g->words[i]);
+    if (g->followers_compressed)
+      free(g->followers_compressed[i]);
+  }
+  if (g->map)
+    munmap(g->map, g->map_len);
+  if (g->succinct)
+    ef_free(g->succinct);
+  for (i = 0; i < g->n_prefixes; i++) {
+    intvec_free(g->prefixes[i].words);
+  }
+  free(g->words);
+  free(g->followers_compressed);
+  free(g->blocks);
+  free(g->rank);
+  free(g);
+}
+
+/* replace the follower lists with Elias-Fano coded ones, which take less
+   memory and are intersected without decoding them. The text lists are
+   freed unless they are mapped from a binary graph. */
+void wordgraph_succinct(struct WordGraph *g) {
+  int *lens = calloc(g->n_words, sizeof *lens), i;
+  for (i = 0; i < g->n_words; i++) {
+    if (g->blocks) {
+      lens[i] = block_count(g->blocks[i]);
+      continue;
+    }
+    /* each number ends in a byte in 0x40..0x5f, and a zero run byte is
+       one more number than its low bits */
+    const unsigned char *p = (const unsigned char *)g->followers_compressed[i];
+    for (; *p; p++)
+      lens[i] += *p >= 0x60 ? (*p & 0x1f) + 1 : *p >> 6 & 1;
+  }
+  struct EliasFano *ef = ef_alloc(g->n_words, g->n_words, lens);
+  free(lens);
+  for (i = 0; i < g->n_words; i++) {
+    struct IntVec *followers = wordgraph_followers(g, i);
+    ef_set(ef, i, followers->data);
+    intvec_free(followers);
+    if (!g->map)
+      free(g->followers_compressed[i]);
+  }
+  g->succinct = ef;
+  if (!g->map) {
+    free(g->followers_compressed);
+    g->followers_compressed = NULL;
+    /* the lists were small allocations, so give their pages back */
+    malloc_trim(0);
+  } else {
+    /* drop the mapped lists from memory, they are read back if needed */
+    uintptr_t page = sysconf(_SC_PAGESIZE), lo, hi;
+    if (g->blocks) {
+      lo = (uintptr_t)g->blocks[0];
+      hi = (uintptr_t)g->blocks[g->n_words];
+    } else {
+      lo = (uintptr_t)g->followers_compressed[0];
+      hi = (uintptr_t)g->followers_compressed[g->n_words - 1] +
+           strlen(g->followers_compressed[g->n_words - 1]);
+    }
+    madvise((void *)(lo / page * page), hi - lo / page * page,
+            MADV_DONTNEED);
+  }
+}
+
+/* return a new IntVec with the followers of a word, in whichever form the
+   graph holds them */
+struct IntVec *wordgraph_followers(struct WordGraph *g, int word) {
+  struct IntVec *followers;
+  int i;
+  if (!g->succinct && !g->blocks)
+    return decode(g->followers_compressed[word]);
+  followers = intvec_alloc();
+  followers->len = g->succinct ? (int)g->succinct->len[word]
+                               : block_count(g->blocks[word]);
+  /* the block decoder writes up to 3 numbers past the end */
+  followers->cap = followers->len + 4;
+  followers->data = realloc(followers->data, sizeof(int) * followers->cap);
+  if (g->succinct)
+    for (i = 0; i < followers->len; i++)
+      followers->data[i] = ef_get(g->succinct, word, i);
+  else
+    block_decode(g->blocks[word], followers->data);
+  return followers;
+}
+
+/* whether a validated graph has a skip table for word's followers */
+static int has_skips(struct WordGraph *g, int word) {
+  return g->skips && g->validated &&
+         g->skip_offs[word + 1] > g->skip_offs[word];
+}
+
+/* intersect word's printable follower list with the len numbers of a,
+   which must be increasing, stopping at the first common number if out is
+   NULL. Before decoding on, jumps to the last skip entry whose follower is
+   below the next number of a, so only the stretches of the list that can
+   hold numbers of a are decoded. */
+static int skip_intersect(struct WordGraph *g, int word, const int *a,
+                          int len, int *out) {
+  const unsigned char *enc =
+      (const unsigned char *)g->followers_compressed[word];
+  const struct SkipEntry *skip = g->skips + g->skip_offs[word];
+  const struct SkipEntry *skips_end = g->skips + g->skip_offs[word + 1];
+  const unsigned char *p = enc, *from = enc;
+  int last_num = 0, zero_run = 0, i = 0, n = 0;
+  STATS_ADD(decode_calls, 1);
+  while (i < len) {
+    for (; skip < skips_end && (int)skip->last < a[i]; skip++) {
+      if (enc + skip->offset > p) {
+        STATS_ADD(decode_bytes, p - from);
+        from = p = enc + skip->offset;
+        last_num = skip->last;
+        zero_run = 0;
+      }
+    }
+    /* a zero run wholly below a[i] is skipped as one */
+    if (zero_run && last_num + zero_run < a[i]) {
+      last_num += zero_run;
+      zero_run = 0;
+      continue;
+    }
+    if (zero_run) {
+      zero_run--;
+      last_num++;
+    } else if (!*p) {
+      break;
+    } else if (*p >= 0x60) {
+      zero_run = *p++ & 0x1f;
+      last_num++;
+    } else {
+      int delta = 0, shift = 0;
+      unsigned char val;
+      do {
+        val = *p++;
+        delta |= (val & 0x1f) << shift;
+        shift += 5;
+      } while (val & 0x20);
+      last_num += delta + 1;
+    }
+    STATS_ADD(decode_ints, 1);
+    while (i < len && a[i] < last_num)
+      i++;
+    if (i < len && a[i] == last_num) {
+      if (!out) {
+        n = 1;
+        break;
+      }
+      out[n++] = a[i++];
+    }
+  }
+  STATS_ADD(decode_bytes, p - from);
+  return n;
+}
+
+/* whether word has a follower in a sorted set of words */
+static int has_follower_in(struct WordGraph *g, int word, struct IntVec *set) {
+  if (g->succinct)
+    return ef_intersects(g->succinct, word, set->data, set->len);
+  if (g->blocks)
+    return block_intersects(g->blocks[word], set->data, set->len);
+  if (has_skips(g, word))
+    return skip_intersect(g, word, set->data, set->len, NULL);
+  struct IntVec *followers = decode(g->followers_compressed[word]);
+  struct IntVec *intersect = intvec_intersect(set, followers);
+  int found = intersect->len > 0;
+  intvec_free(intersect);
+  intvec_free(followers);
+  return found;
+}
+
+/* return a new IntVec with the followers of word in a sorted set */
+static struct IntVec *followers_in(struct WordGraph *g, int word,
+                                   struct IntVec *set) {
+  struct IntVec *intersect;
+  if (g->succinct || g->blocks || has_skips(g, word)) {
+    intersect = intvec_alloc();
+    intersect->cap = set->len ? set->len : 1;
+    intersect->data = realloc(intersect->data, sizeof(int) * intersect->cap);
+    if (g->succinct)
+      intersect->len = ef_intersect(g->succinct, word, set->data, set->len,
+                                    intersect->data);
+    else if (g->blocks)
+      intersect->len = block_intersect(g->blocks[word], set->data, set->len,
+                                       intersect->data);
+    else
+      intersect->len = skip_intersect(g, word, set->data, set->len,
+                                      intersect->data);
+    return intersect;
+  }
+  struct IntVec *followers = decode(g->followers_compressed[word]);
+  intersect = intvec_intersect(set, followers);
+  intvec_free(followers);
+  return intersect;
+}
+
+/* the reason an encoded follower list or its n_skips skip entries are
+   invalid, or NULL if the list decodes to strictly increasing word numbers
+   in [1, n_words) and each entry points at the start of a number or zero
+   run, with the number before it. Unlike decode, never reads past the end
+   of the string. */
+static const char *check_list(const char *enc, int n_words,
+                              const struct SkipEntry *skips, int n_skips) {
+  const unsigned char *p = (const unsigned char *)enc;
+  long last_num = 0;
+  for (;;) {
+    size_t pos = p - (const unsigned char *)enc;
+    if (n_skips && skips->offset <= pos) {
+      if (skips->offset < pos || skips->last != last_num)
+        return "bad skip entry";
+      skips++;
+      n_skips--;
+    }
+    if (!*p)
+      break;
+    if (*p >= 0x80)
+      return "bad byte";
+    if (*p >= 0x60) {
+      last_num += (*p++ & 0x1f) + 1;
+    } else {
+      long delta = 0;
+      int shift = 0;
+      unsigned char val;
+      do {
+        val = *p++;
+        if (val < 0x20 || val >= 0x60)
+          return val ? "bad byte" : "truncated number";
+        if (shift > 30)
+          return "number too large";
+        delta |= (long)(val & 0x1f) << shift;
+        shift += 5;
+      } while (val & 0x20);
+      last_num += delta + 1;
+    }
+    if (last_num >= n_words)
+      return "follower out of range";
+  }
+  return n_skips ? "bad skip entry" : NULL;
+}
+
+struct Validation {
+  struct WordGraph *g;
+  int thread, n_threads;
+  int bad; /* the lowest invalid word, or n_words */
+  const char *why;
+};
+
+static void *validate_stripe(void *arg) {
+  struct Validation *v = arg;
+  struct WordGraph *g = v->g;
+  int word;
+  /* interleave words, since the frequent ones have the longest lists */
+  for (word = v->thread; word < g->n_words; word += v->n_threads) {
+    const char *why = NULL;
+    if (word && strlen(g->words[word]) < PREFIX_LEN)
+      why = "word shorter than a prefix";
+    else if (g->blocks)
+      why = block_check(g->blocks[word], g->blocks[word + 1] - g->blocks[word],
+                        g->n_words);
+    else
+      why = check_list(g->followers_compressed[word], g->n_words,
+                       g->skips ? g->skips + g->skip_offs[word] : NULL,
+                       g->skips ? g->skip_offs[word + 1] - g->skip_offs[word]
+                                : 0);
+    if (why) {
+      v->bad = word;
+      v->why = why;
+      break;
+    }
+  }
+  return NULL;
+}
+
+/* decode every follower list on n_threads threads and check the ranks.
+   Returns -1 and marks the graph validated if it is valid, or else warns
+   about and returns the lowest invalid word. */
+int wordgraph_validate(struct WordGraph *g, int n_threads) {
+  int i, bad = g->n_words;
+  const char *why = NULL;
+  if (n_threads < 1)
+    n_threads = 1;
+  struct Validation v[n_threads];
+  pthread_t threads[n_threads];
+  for (i = 0; i < n_threads; i++) {
+    v[i] = (struct Validation){g, i, n_threads, g->n_words, NULL};
+    if (i && pthread_create(&threads[i], NULL, validate_stripe, &v[i]))
+      errx(2, "unable to create validation thread");
+  }
+  validate_stripe(&v[0]);
+  for (i = 0; i < n_threads; i++) {
+    if (i)
+      pthread_join(threads[i], NULL);
+    if (v[i].bad < bad) {
+      bad = v[i].bad;
+      why = v[i].why;
+    }
+  }
+  if (g->rank) {
+    char *seen = calloc(g->n_words, 1);
+    for (i = 0; i < g->n_words; i++) {
+      if (g->rank[i] < 0 || g->rank[i] >= g->n_words || seen[g->rank[i]]++) {
+        if (i < bad) {
+          bad = i;
+          why = "ranks are not a permutation";
+        }
+        break;
+      }
+    }
+    free(seen);
+  }
+  if (bad < g->n_words) {
+    warnx("invalid word %d: %s", bad, why);
+    return bad;
+  }
+  g->validated = 1;
+  return -1;
+}
+
+/* write one section at the aligned end of out, noting it in the table */
+static void write_section(FILE *out, struct GraphSection *section,
+                          uint32_t type, const void *data, size_t len) {
+  static const char zeros[8];
+  long pos = ftell(out);
+  fwrite(zeros, 1, -pos & 7, out);
+  section->type = type;
+  section->offset = pos + (-pos & 7);
+  section->length = len;
+  section->crc = crc32c(0, data, len);
+  fwrite(data, 1, len, out);
+}
+
+/* write the strings back to back with their offsets as two sections */
+static void write_strings(FILE *out, struct GraphSection *sections,
+                          uint32_t type, uint32_t offs_type,
+                          char **strings, int n) {
+  uint64_t *offs = malloc((n + 1) * sizeof *offs);
+  int i;
+  offs[0] = 0;
+  for (i = 0; i < n; i++)
+    offs[i + 1] = offs[i] + strlen(strings[i] ? strings[i] : "") + 1;
+  char *data = malloc(offs[n]);
+  for (i = 0; i < n; i++)
+    memcpy(data + offs[i], strings[i] ? strings[i] : "",
+           offs[i + 1] - offs[i]);
+  write_section(out, &sections[0], type, data, offs[n]);
+  write_section(out, &sections[1], offs_type, offs, (n + 1) * sizeof *offs);
+  free(data);
+  free(offs);
+}
+
+/* write the follower lists block coded, with their offsets */
+static void write_blocks(FILE *out, struct GraphSection *sections,
+                         struct WordGraph *g) {
+  uint64_t *offs = malloc((g->n_words + 1) * sizeof *offs);
+  size_t len = 0, cap = 1 << 20;
+  uint8_t *data = malloc(cap);
+  int i;
+  for (i = 0; i < g->n_words; i++) {
+    struct IntVec *followers = g->blocks ? NULL : wordgraph_followers(g, i);
+    size_t bound = g->blocks ? block_size(g->blocks[i])
+                             : block_bound(followers->len);
+    if (len + bound + BLOCK_PAD > cap) {
+      while (len + bound + BLOCK_PAD > cap)
+        cap *= 2;
+      data = realloc(data, cap);
+    }
+    offs[i] = len;
+    if (g->blocks) {
+      memcpy(data + len, g->blocks[i], bound);
+      len += bound;
+    } else {
+      len += block_encode(followers->data, followers->len, data + len);
+      intvec_free(followers);
+    }
+  }
+  offs[g->n_words] = len;
+  memset(data + len, 0, BLOCK_PAD);
+  write_section(out, &sections[0], GRAPH_BLOCKS, data, len + BLOCK_PAD);
+  write_section(out, &sections[1], GRAPH_BLOCK_OFFS, offs,
+                (g->n_words + 1) * sizeof *offs);
+  free(data);
+  free(offs);
+}
+
+/* write skip tables for the long lists, an entry at the first number or
+   zero run at least SKIP_EVERY followers after the last one. Returns
+   whether every table checks out against its list, as validation would
+   check it. */
+static int write_skips(FILE *out, struct GraphSection *sections,
+                       char **lists, int n) {
+  uint64_t *offs = malloc((n + 1) * sizeof *offs);
+  size_t len = 0, cap = 1024;
+  struct SkipEntry *skips = malloc(cap * sizeof *skips);
+  int i;
+  offs[0] = 0;
+  for (i = 0; i < n; i++) {
+    const unsigned char *enc = (const unsigned char *)lists[i], *p = enc;
+    size_t first = len;
+    int count = 0, next = SKIP_EVERY, last_num = 0;
+    while (*p) {
+      if (count >= next) {
+        if (len == cap)
+          skips = realloc(skips, (cap *= 2) * sizeof *skips);
+        skips[len++] = (struct SkipEntry){p - enc, last_num};
+        next = count + SKIP_EVERY;
+      }
+      if (*p >= 0x60) {
+        count += (*p & 0x1f) + 1;
+        last_num += (*p++ & 0x1f) + 1;
+      } else {
+        int delta = 0, shift = 0;
+        do {
+          delta |= (*p & 0x1f) << shift;
+          shift += 5;
+        } while (*p++ & 0x20);
+        count++;
+        last_num += delta + 1;
+      }
+    }
+    if (count < SKIP_MIN_LEN)
+      len = first;
+    offs[i + 1] = len;
+  }
+  int valid = 1;
+  for (i = 0; i < n && valid; i++)
+    if (offs[i + 1] > offs[i])
+      valid = !check_list(lists[i], n, skips + offs[i], offs[i + 1] - offs[i]);
+  write_section(out, &sections[0], GRAPH_SKIPS, skips, len * sizeof *skips);
+  write_section(out, &sections[1], GRAPH_SKIP_OFFS, offs,
+                (n + 1) * sizeof *offs);
+  free(skips);
+  free(offs);
+  return valid;
+}
+
+/* write the graph in the binary format, marked validated if it has been
+   and its new skip tables check out. The follower lists are block coded if
+   blocked, or else printable with skip tables. */
+void wordgraph_write_binary(struct WordGraph *g, const char *filename,
+                            int blocked) {
+  struct GraphHeader header = {.n_words = g->n_words,
+                               .flags = g->validated ? GRAPH_VALIDATED : 0};
+  struct GraphSection sections[7] = {{0}};
+  char tmp[4096];
+  int i, skips_valid = 1;
+
+  memcpy(header.magic, GRAPH_MAGIC, sizeof header.magic);
+  header.n_sections = 4 + 2 * !blocked + !!g->rank;
+  snprintf(tmp, sizeof tmp, "%s.tmp", filename);
+  FILE *out = fopen(tmp, "w");
+  if (!out)
+    err(2, "unable to create %s", tmp);
+  fseek(out, sizeof header + header.n_sections * sizeof sections[0],
+        SEEK_SET);
+  write_strings(out, &sections[0], GRAPH_WORDS, GRAPH_WORD_OFFS, g->words,
+                g->n_words);
+  if (blocked) {
+    write_blocks(out, &sections[2], g);
+  } else if (g->followers_compressed) {
+    write_strings(out, &sections[2], GRAPH_FOLLOWERS, GRAPH_FOLLOWER_OFFS,
+                  g->followers_compressed, g->n_words);
+    skips_valid = write_skips(out, &sections[4], g->followers_compressed,
+                              g->n_words);
+  } else {
+    char **lists = malloc(g->n_words * sizeof *lists);
+    for (i = 0; i < g->n_words; i++) {
+      struct IntVec *followers = wordgraph_followers(g, i);
+      lists[i] = encode(followers->data, followers->len);
+      intvec_free(followers);
+    }
+    write_strings(out, &sections[2], GRAPH_FOLLOWERS, GRAPH_FOLLOWER_OFFS,
+                  lists, g->n_words);
+    skips_valid = write_skips(out, &sections[4], lists, g->n_words);
+    for (i = 0; i < g->n_words; i++)
+      free(lists[i]);
+    free(lists);
+  }
+  if (g->rank) {
+    uint32_t *ranks = malloc(g->n_words * sizeof *ranks);
+    for (i = 0; i < g->n_words; i++)
+      ranks[i] = g->rank[i];
+    write_section(out, &sections[header.n_sections - 1], GRAPH_RANKS, ranks,
+                  g->n_words * sizeof *ranks);
+    free(ranks);
+  }
+  if (!skips_valid) {
+    warnx("%s: bad skip table, not marking it validated", filename);
+    header.flags &= ~GRAPH_VALIDATED;
+  }
+  header.crc = crc32c(crc32c(0, &header, sizeof header), sections,
+                      header.n_sections * sizeof sections[0]);
+  rewind(out);
+  fwrite(&header, sizeof header, 1, out);
+  fwrite(sections, sizeof sections[0], header.n_sections, out);
+  if (ferror(out) | fclose(out))
+    err(2, "unable to write %s", tmp);
+  if (rename(tmp, filename))
+    err(2, "unable to rename %s to %s", tmp, filename);
+}
+
+/* decode an adjacency list encoded as a string */
+struct IntVec *decode(char *enc) {
+  /*
+  general encoding steps:
+  input: [1, 2, 3, 5, 80]
+  subtract previous value: [1, 1, 1, 2, 75]
+  subtract 1: [0, 0, 0, 1, 74]
+  contract runs of zeros: [0x3, 1, 74]
+  printably encode numbers as base-32 varints,
+  and runs of zeros as the 31 leftover characters:
+  output: "bA*B"
+
+  this function reverses the steps.
+
+  Cf. decode in digest.py
+  */
+  int enc_ind = 0;
+  struct IntVec *dec = intvec_alloc();
+  int last_num = 0;
+  int zero_run = 0;
+  while (enc[enc_ind] || zero_run) {
+    int delta = 0;
+    int delta_ind = 0;
+    if (zero_run)
+      zero_run--;
+    else {
+      unsigned char val = enc[enc_ind];
+      if (val >= 0x60) {
+        zero_run = enc[enc_ind] & 0x1f;
+        delta_ind++;
+      } else {
+        /* decode base-32 varint */
+        do {
+          val = enc[enc_ind + delta_ind];
+          delta |= (val & 0x1f) << (5 * delta_ind);
+          delta_ind++;
+        } while (val & 0x20);
+      }
+    }
+    enc_ind += delta_ind;
+    last_num += delta + 1;
+    intvec_append(dec, last_num);
+  }
+  STATS_ADD(decode_calls, 1);
+  STATS_ADD(decode_bytes, enc_ind);
+  STATS_ADD(decode_ints, dec->len);
+  return dec;
+}
+
+/* encode a sorted adjacency list of positive numbers as a new string, the
+   inverse of decode. Cf. encode in digest.py */
+char *encode(const int *nums, int len) {
+  /* a number takes at most 7 bytes, a zero run of 31 numbers one byte */
+  char *enc = malloc(7 * len + 1);
+  int i, pos = 0, last_num = 0, zero_run = 0;
+  for (i = 0; i <= len; i++) {
+    unsigned delta = 0;
+    if (i < len) {
+      delta = nums[i] - last_num - 1;
+      last_num = nums[i];
+      if (!delta) {
+        zero_run++;
+        continue;
+      }
+    }
+    while (zero_run) {
+      int run = zero_run < 0x1f ? zero_run : 0x1f;
+      enc[pos++] = 0x60 + run - 1;
+      zero_run -= run;
+    }
+    if (i == len)
+      break;
+    do {
+      enc[pos++] = (delta < 0x20 ? 0x40 : 0x20) | (delta & 0x1f);
+      delta >>= 5;
+    } while (delta);
+  }
+  enc[pos] = 0;
+  return enc;
+}
+
+void wordgraph_dump(struct WordGraph *g, int a, int b) {
+  int i;
+  for (i = a; i < b; i++) {
+    printf("#%d: %s: %.30s ", i, g->words[i],
+           g->followers_compressed ? g->followers_compressed[i] : "");
+    struct IntVec *followers = wordgraph_followers(g, i);
+    intvec_print(followers);
+    intvec_free(followers);
+    printf("\n");
+  }
+}
+
+static int min(int a, int b) {
+  if (a <= b)
+    return a;
+  return b;
+}
+
+int edit_distance(const char *a, const char *b) {
+  // code based off http://hetland.org/coding/python/levenshtein.py
+
+  int n = strlen(a), m = strlen(b);
+
+  if (n > m) {
+    // ensure n <= m, to use O(min(n,m)) space
+    const char *tmp_s = a;
+    a = b;
+    b = tmp_s;
+    int tmp_i = n;
+    n = m;
+    m = tmp_i;
+  }
+
+  int cost[n + 1];
+
+  int i, j;
+  int ins, del, sub;
+  int prevdiag; // lets us store only one row + one cell at a time
+
+  const int insert_cost = 1;
+  const int gap_cost = 1;
+  const int mismatch_cost = 1;
+
+  for (i = 0; i < n + 1; ++i)
+    cost[i] = i * insert_cost;
+
+  for (i = 1; i < m + 1; ++i) {
+    prevdiag = cost[0];
+    cost[0] = i * gap_cost;
+
+    for (j = 1; j < n + 1; ++j) {
+      ins = cost[j] + gap_cost;
+      del = cost[j - 1] + gap_cost;
+      sub = prevdiag;
+      if (a[j - 1] != b[i - 1])
+        sub += mismatch_cost;
+      prevdiag = cost[j];
+      cost[j] = min(ins, min(del, sub));
+    }
+  }
+
+  return cost[n];
+}
+
+/* find the closest word to the input */
+int wordgraph_find_word(struct WordGraph *g, const char *word) {
+  int i, best_word = 0, best_dist = 10000;
+  int *by_rank = wordgraph_words_by_rank(g);
+  for (i = 1; i < g->n_words; i++) {
+    int dist = edit_distance(word, g->words[by_rank[i]]);
+    if (dist < best_dist) {
+      best_dist = dist;
+      best_word = by_rank[i];
+    }
+  }
+  free(by_rank);
+  return best_word;
+}
+
+/* find a mnemonic phrase for a series of prefixes, storing the word picked
+   for each prefix in words_out. Returns the number of impossible links. */
+int wordgraph_phrase(struct WordGraph *g, const int *prefixes_chosen,
+                     int length, int start_word, int *words_out) {
+  int i, j;
+  /* find possible words for each of the chosen prefixes */
+  struct IntVec *word_sets[length];
+  for (i = 0; i < length; i++)
+    word_sets[i] = intvec_copy(g->prefixes[prefixes_chosen[i]].words);
+
+  /* working backwards, reduce possible words for each prefix to only
+     those words that have a link to a word in the next set of possible words
+   */
+  int mismatch = 0; /* track how many links were impossible */
+  struct IntVec *next_words, *new_words, *words, *intersect;
+  next_words = NULL;
+  STATS_START(backward_start);
+  PERF_BEGIN(PERF_BACKWARD);
+  for (i = length - 1; i >= 0; i--) {
+    words = word_sets[i];
+    new_words = intvec_alloc();
+    if (next_words) {
+      for (j = 0; j < words->len; j++) {
+        int word = intvec_get(words, j);
+        if (has_follower_in(g, word, next_words))
+          intvec_append(new_words, word);
+      }
+    }
+    if (new_words->len) {
+      intvec_free(word_sets[i]);
+      word_sets[i] = new_words;
+    } else {
+      intvec_free(new_words);
+      if (next_words)
+        mismatch++;
+    }
+
+    next_words = word_sets[i];
+  }
+
+  STATS_STOP(backward_ticks, backward_start);
+  PERF_END(PERF_BACKWARD);
+
+  /* working forwards, pick a word for each prefix */
+  STATS_START(forward_start);
+  PERF_BEGIN(PERF_FORWARD);
+  int last_word = start_word;
+  for (i = 0; i < length; i++) {
+    intersect = followers_in(g, last_word, word_sets[i]);
+    /* Picking the most frequent word available biases the phrase towards
+     * more common words, and produces generally satisfactory results.
+     * N.B.: to save space, adjacency lists don't encode probabilities */
+    last_word = preferred_word(g, intersect->len ? intersect : word_sets[i]);
+    words_out[i] = last_word;
+    intvec_free(intersect);
+  }
+
+  for (i = 0; i < length; i++) {
+    intvec_free(word_sets[i]);
+  }
+  STATS_STOP(forward_ticks, forward_start);
+  PERF_END(PERF_FORWARD);
+  STATS_ADD(phrases, 1);
+  STATS_ADD(mismatches, mismatch);
+
+  return mismatch;
+}
+
+/* split a password into prefix indexes. Returns the number of prefixes, or
+   -1 if it isn't made of prefixes from the graph. */
+int wordgraph_split_password(struct WordGraph *g, const char *password,
+                             int *prefixes_out, int max_length) {
+  int len = strlen(password), i;
+  if (len % PREFIX_LEN || len / PREFIX_LEN > max_length)
+    return -1;
+  for (i = 0; i < len / PREFIX_LEN; i++) {
+    prefixes_out[i] = wordgraph_prefix_index(g, password + i * PREFIX_LEN);
+    if (prefixes_out[i] < 0)
+      return -1;
+  }
+  return len / PREFIX_LEN;
+}
+
+/* pack a series of at most MAX_RANK_LEN prefix indexes into a rank */
+uint64_t wordgraph_rank_prefixes(const int *prefixes, int length) {
+  uint64_t rank = 0;
+  int i;
+  for (i = 0; i < length; i++)
+    rank = rank << PREFIX_BITS | prefixes[i];
+  return rank;
+}
+
+/* pack a password into its rank. Returns the number of prefixes, or -1 if
+   it isn't a password of 1 to MAX_RANK_LEN prefixes. */
+int wordgraph_rank(struct WordGraph *g, const char *password, uint64_t *rank) {
+  int prefixes[MAX_RANK_LEN];
+  int length = wordgraph_split_password(g, password, prefixes, MAX_RANK_LEN);
+  if (length <= 0) {
+    *rank = 0;
+    return -1;
+  }
+  *rank = wordgraph_rank_prefixes(prefixes, length);
+  return length;
+}
+
+/* write the password with a rank to password, which must have room for
+   length * PREFIX_LEN + 1 bytes */
+void wordgraph_unrank(struct WordGraph *g, uint64_t rank, int length,
+                      char *password) {
+  int i;
+  for (i = length - 1; i >= 0; i--) {
+    memcpy(password + i * PREFIX_LEN,
+           g->prefixes[rank & (MAX_PREFIXES - 1)].prefix, PREFIX_LEN);
+    rank >>= PREFIX_BITS;
+  }
+  password[length * PREFIX_LEN] = 0;
+}
+
+/* rank n passwords of the same length, stored back to back without
+   separators. Passwords that can't be ranked get UINT64_MAX.
+   Returns the number of passwords ranked successfully. */
+size_t wordgraph_rank_array(struct WordGraph *g, const char *passwords,
+                            int length, uint64_t *ranks, size_t n) {
+  size_t i, ok = 0;
+  int j;
+  for (i = 0; i < n; i++) {
+    const char *password = passwords + i * length * PREFIX_LEN;
+    uint64_t rank = 0;
+    for (j = 0; j < length; j++) {
+      int p = wordgraph_prefix_index(g, password + j * PREFIX_LEN);
+      if (p < 0)
+        break;
+      rank = rank << PREFIX_BITS | p;
+    }
+    ranks[i] = length && j == length ? rank : UINT64_MAX;
+    ok += length && j == length;
+  }
+  return ok;
+}
+
+/* the inverse of wordgraph_rank_array */
+void wordgraph_unrank_array(struct WordGraph *g, const uint64_t *ranks,
+                            int length, char *passwords, size_t n) {
+  size_t i;
+  int j;
+  for (i = 0; i < n; i++) {
+    char *password = passwords + i * length * PREFIX_LEN;
+    uint64_t rank = ranks[i];
+    for (j = length - 1; j >= 0; j--) {
+      memcpy(password + j * PREFIX_LEN,
+             g->prefixes[rank & (MAX_PREFIXES - 1)].prefix, PREFIX_LEN);
+      rank >>= PREFIX_BITS;
+    }
+  }
+}
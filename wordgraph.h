@@ -0,0 +1,152 @@
+#ifndef WORDGRAPH_H
+#define WORDGRAPH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define MAX_PREFIXES 1024
+#define PREFIX_LEN 3
+
+/* prefixes are lowercase ascii, so 5 bits per letter are enough to index a
+   direct lookup table for any 3-letter prefix */
+#define PREFIX_KEY_BITS (5 * PREFIX_LEN)
+#define PREFIX_KEY(p) \
+  ((((p)[0] & 0x1f) << 10) | (((p)[1] & 0x1f) << 5) | ((p)[2] & 0x1f))
+
+struct EliasFano;
+
+/* an entry of the skip table of a long printable follower list: the byte
+   offset of a number or zero run in the list, and the follower before it,
+   so decoding can start there */
+struct SkipEntry {
+  uint32_t offset;
+  uint32_t last;
+};
+
+/* lists of at least SKIP_MIN_LEN followers get an entry about every
+   SKIP_EVERY followers */
+#define SKIP_MIN_LEN 256
+#define SKIP_EVERY 128
+
+struct IntVec {
+  int len;
+  int cap;
+  int *data;
+};
+
+/* a password of up to MAX_RANK_LEN prefixes packs into a 64-bit rank, with
+   PREFIX_BITS per prefix and the first prefix in the most significant bits */
+#define PREFIX_BITS 10
+#define MAX_RANK_LEN (64 / PREFIX_BITS)
+
+struct WordGraph {
+  int n_words;
+  int n_prefixes;
+  char **words;
+  char **followers_compressed;
+  /* the frequency rank of each word, if the graph was renumbered to make
+     follower lists smaller; NULL if word numbers are frequency ranks */
+  int *rank;
+  struct {
+    char prefix[PREFIX_LEN];
+    struct IntVec *words;
+  } prefixes[MAX_PREFIXES];
+  /* PREFIX_KEY -> index into prefixes + 1, or 0 if unused */
+  short prefix_table[1 << PREFIX_KEY_BITS];
+  /* set once every follower list and skip table has been checked. It only
+     enables the skip tables and lets --validate skip a marked graph; the
+     follower lists are decoded the same way either way */
+  int validated;
+  /* a binary graph is mapped, and words and followers point into it */
+  void *map;
+  /* a binary graph's follower lists in the block coding of blockcode.h
+     instead of followers_compressed, with the end of the last list after
+     them; NULL otherwise */
+  uint8_t **blocks;
+  /* a binary graph's skip tables, with the index of each word's first
+     entry and the end; NULL if it has none. Only used once validated. */
+  const struct SkipEntry *skips;
+  const uint64_t *skip_offs;
+  size_t map_len;
+  /* the follower lists Elias-Fano coded, replacing followers_compressed
+     (which is NULL unless mapped) after wordgraph_succinct */
+  struct EliasFano *succinct;
+};
+
+/* The binary graph format: a header, a table of n_sections sections, and
+   the sections, each 8-byte aligned. The header CRC-32C covers the header
+   and the section table, computed with the crc field set to 0, and each
+   section has the CRC-32C of its data. GRAPH_VALIDATED is set by graphcheck
+   after decoding every list, so loading it can skip that. The follower
+   lists are either printable strings like those of the text graph, or
+   block coded lists followed by BLOCK_PAD bytes of padding. Printable
+   lists may have skip tables, which older readers ignore. Numbers are
+   little-endian. */
+#define GRAPH_MAGIC "ABGRAPH1"
+#define GRAPH_VALIDATED 1
+
+enum GraphSectionType {
+  GRAPH_WORDS = 1,        /* NUL-terminated words, "" for word 0 */
+  GRAPH_WORD_OFFS,        /* uint64_t offset of each word, and the end */
+  GRAPH_FOLLOWERS,        /* NUL-terminated encoded follower lists */
+  GRAPH_FOLLOWER_OFFS,    /* uint64_t offset of each list, and the end */
+  GRAPH_RANKS,            /* optional uint32_t frequency rank of each word */
+  GRAPH_BLOCKS,           /* block coded follower lists, see blockcode.h */
+  GRAPH_BLOCK_OFFS,       /* uint64_t offset of each list, and the end */
+  GRAPH_SKIPS,            /* optional SkipEntry tables of long lists */
+  GRAPH_SKIP_OFFS,        /* uint64_t first entry of each list, and the end */
+};
+
+struct GraphHeader {
+  char magic[8];
+  uint32_t n_words;
+  uint32_t n_sections;
+  uint32_t flags;
+  uint32_t crc;
+};
+
+struct GraphSection {
+  uint32_t type;
+  uint32_t crc;
+  uint64_t offset;
+  uint64_t length;
+};
+
+struct IntVec *intvec_alloc();
+void intvec_free(struct IntVec *vec);
+void intvec_append(struct IntVec *vec, int val);
+int intvec_get(struct IntVec *vec, int pos);
+struct IntVec *intvec_copy(struct IntVec *vec);
+void intvec_print(struct IntVec *vec);
+struct IntVec *intvec_intersect(struct IntVec *a, struct IntVec *b);
+
+struct WordGraph *wordgraph_init(const char *filename);
+void wordgraph_free(struct WordGraph *g);
+int wordgraph_validate(struct WordGraph *g, int n_threads);
+void wordgraph_write_binary(struct WordGraph *g, const char *filename,
+                            int blocked);
+struct IntVec *wordgraph_followers(struct WordGraph *g, int word);
+void wordgraph_succinct(struct WordGraph *g);
+int *wordgraph_words_by_rank(struct WordGraph *g);
+int wordgraph_prefix_index(struct WordGraph *g, const char *prefix);
+struct IntVec *decode(char *enc);
+char *encode(const int *nums, int len);
+void wordgraph_dump(struct WordGraph *g, int a, int b);
+int edit_distance(const char *a, const char *b);
+int wordgraph_find_word(struct WordGraph *g, const char *word);
+int wordgraph_phrase(struct WordGraph *g, const int *prefixes_chosen,
+                     int length, int start_word, int *words_out);
+int wordgraph_split_password(struct WordGraph *g, const char *password,
+                             int *prefixes_out, int max_length);
+
+uint64_t wordgraph_rank_prefixes(const int *prefixes, int length);
+int wordgraph_rank(struct WordGraph *g, const char *password, uint64_t *rank);
+void wordgraph_unrank(struct WordGraph *g, uint64_t rank, int length,
+                      char *password);
+size_t wordgraph_rank_array(struct WordGraph *g, const char *passwords,
+                            int length, uint64_t *ranks, size_t n);
+void wordgraph_unrank_array(struct WordGraph *g, const uint64_t *ranks,
+                            int length, char *passwords, size_t n);
+
+#endif
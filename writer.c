@@ -0,0 +1,193 @@
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "crc32c.h"
+#include "writer.h"
+
+#define SHARD_ALIGN 4096
+#define SHARD_BUF_SIZE (1 << 20)
+
+static void set_direct(struct Shard *s, int on) {
+  int flags = fcntl(s->fd, F_GETFL);
+  if (flags < 0 ||
+      fcntl(s->fd, F_SETFL, on ? flags | O_DIRECT : flags & ~O_DIRECT))
+    err(11, "unable to %s O_DIRECT", on ? "set" : "clear");
+}
+
+static void pwrite_all(struct Shard *s, const char *data, size_t len,
+                       long long offset) {
+  while (len) {
+    ssize_t n = pwrite(s->fd, data, len, offset);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      err(11, "unable to write shard");
+    }
+    data += n;
+    len -= n;
+    offset += n;
+  }
+}
+
+/* write out the buffer. With O_DIRECT only whole blocks can be written, so
+   unless all is set a partial block stays in the buffer. If it is set, the
+   partial block is written without O_DIRECT, but kept in the buffer so the
+   next write starts at an aligned offset again. */
+static void shard_drain(struct Shard *s, int all) {
+  struct ShardWriter *w = s->w;
+  size_t n = w->direct ? s->len & ~(size_t)(SHARD_ALIGN - 1) : s->len;
+  pwrite_all(s, s->buf, n, s->base);
+  s->unsynced += n;
+  if (all && n < s->len) {
+    set_direct(s, 0);
+    pwrite_all(s, s->buf + n, s->len - n, s->base + n);
+    set_direct(s, 1);
+  }
+  memmove(s->buf, s->buf + n, s->len - n);
+  s->len -= n;
+  s->base += n;
+  if (w->sync_bytes && s->unsynced >= w->sync_bytes) {
+    if (fdatasync(s->fd))
+      err(11, "unable to sync shard");
+    s->unsynced = 0;
+  }
+}
+
+static ssize_t shard_cookie_write(void *cookie, const char *data,
+                                  size_t size) {
+  struct Shard *s = cookie;
+  size_t left = size;
+  s->state.crc = crc32c(s->state.crc, data, size);
+  s->state.bytes += size;
+  while (left) {
+    size_t n = SHARD_BUF_SIZE - s->len;
+    if (n > left)
+      n = left;
+    memcpy(s->buf + s->len, data, n);
+    s->len += n;
+    data += n;
+    left -= n;
+    if (s->len == SHARD_BUF_SIZE)
+      shard_drain(s, 0);
+  }
+  return size;
+}
+
+static void shard_open(struct ShardWriter *w, int i,
+                       const struct ShardState *resume) {
+  struct Shard *s = &w->shards[i];
+  size_t len = strlen(w->prefix) + 5;
+  char path[len];
+  snprintf(path, len, "%s.%03d", w->prefix, i);
+  s->w = w;
+  s->fd = open(path, O_RDWR | O_CREAT | (resume ? 0 : O_TRUNC), 0644);
+  if (s->fd < 0)
+    err(1, "unable to open %s", path);
+  if (posix_memalign((void **)&s->buf, SHARD_ALIGN, SHARD_BUF_SIZE))
+    errx(11, "unable to allocate shard buffer");
+  s->len = 0;
+  s->base = 0;
+  s->unsynced = 0;
+  memset(&s->state, 0, sizeof s->state);
+  if (resume) {
+    /* drop anything after the checkpoint, and reload the partial block at
+       the end so writes stay aligned */
+    s->state = *resume;
+    if (ftruncate(s->fd, s->state.bytes))
+      err(9, "unable to truncate %s", path);
+    s->base = w->direct ? s->state.bytes & ~(SHARD_ALIGN - 1) : s->state.bytes;
+    s->len = s->state.bytes - s->base;
+    if (pread(s->fd, s->buf, s->len, s->base) != (ssize_t)s->len)
+      err(9, "unable to read %s", path);
+  }
+  if (w->direct)
+    set_direct(s, 1);
+  cookie_io_functions_t io = {NULL, shard_cookie_write, NULL, NULL};
+  s->file = fopencookie(s, "w", io);
+  if (!s->file)
+    err(11, "unable to open %s", path);
+}
+
+/* open the shards of an output. When resuming, resume gives the state of
+   each shard at the last checkpoint. */
+struct ShardWriter *shard_writer_open(const char *prefix, int n_shards,
+                                      int direct, long long sync_bytes,
+                                      const struct ShardState *resume) {
+  struct ShardWriter *w = malloc(sizeof *w);
+  int i;
+  if (n_shards < 1 || n_shards > MAX_SHARDS)
+    errx(4, "number of shards must be between 1 and %d", MAX_SHARDS);
+  w->prefix = strdup(prefix);
+  w->n_shards = n_shards;
+  w->direct = direct;
+  w->sync_bytes = sync_bytes;
+  w->shards = calloc(n_shards, sizeof w->shards[0]);
+  for (i = 0; i < n_shards; i++)
+    shard_open(w, i, resume ? &resume[i] : NULL);
+  return w;
+}
+
+FILE *shard_writer_file(struct ShardWriter *w, int shard) {
+  return w->shards[shard].file;
+}
+
+/* note that a password was written to a shard */
+void shard_writer_count(struct ShardWriter *w, int shard) {
+  w->shards[shard].state.count++;
+}
+
+/* write everything buffered so far to the shard files */
+void shard_writer_flush(struct ShardWriter *w) {
+  int i;
+  for (i = 0; i < w->n_shards; i++) {
+    if (fflush(w->shards[i].file))
+      err(11, "unable to write shard");
+    shard_drain(&w->shards[i], 1);
+  }
+}
+
+void shard_writer_state(struct ShardWriter *w, struct ShardState *states) {
+  int i;
+  for (i = 0; i < w->n_shards; i++)
+    states[i] = w->shards[i].state;
+}
+
+void shard_writer_fds(struct ShardWriter *w, int *fds) {
+  int i;
+  for (i = 0; i < w->n_shards; i++)
+    fds[i] = w->shards[i].fd;
+}
+
+/* flush and close the shards, and write PREFIX.manifest listing each
+   shard's password count, size and checksum */
+void shard_writer_close(struct ShardWriter *w, const char *description) {
+  size_t len = strlen(w->prefix) + 10;
+  char path[len];
+  int i;
+  shard_writer_flush(w);
+  snprintf(path, len, "%s.manifest", w->prefix);
+  FILE *manifest = fopen(path, "w");
+  if (!manifest)
+    err(11, "unable to write %s", path);
+  fprintf(manifest, "%s\n", description);
+  for (i = 0; i < w->n_shards; i++) {
+    struct Shard *s = &w->shards[i];
+    fprintf(manifest, "%s.%03d\t%ld\t%lld\t%08x\n", w->prefix, i,
+            s->state.count, s->state.bytes, s->state.crc);
+    fclose(s->file);
+    if (fdatasync(s->fd) || close(s->fd))
+      err(11, "unable to write shard");
+    free(s->buf);
+  }
+  if (fclose(manifest))
+    err(11, "unable to write %s", path);
+  free(w->shards);
+  free(w->prefix);
+  free(w);
+}
@@ -0,0 +1,47 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define MAX_SHARDS 256
+
+/* how far a shard has been written, for checkpoints and manifests */
+struct ShardState {
+  long long bytes;
+  long count;
+  uint32_t crc; /* CRC-32C of the bytes */
+};
+
+/* output split over several files, each written through a large aligned
+   buffer. Shard i of an output named PREFIX is PREFIX.00i. */
+struct Shard {
+  struct ShardWriter *w;
+  int fd;
+  FILE *file;         /* stdio stream writing into buf */
+  char *buf;          /* data starting at file offset base */
+  size_t len;
+  long long base;
+  long long unsynced; /* bytes written since the last fdatasync */
+  struct ShardState state;
+};
+
+struct ShardWriter {
+  char *prefix;
+  int n_shards;
+  int direct;           /* use O_DIRECT */
+  long long sync_bytes; /* fdatasync each shard after this many bytes */
+  struct Shard *shards;
+};
+
+struct ShardWriter *shard_writer_open(const char *prefix, int n_shards,
+                                      int direct, long long sync_bytes,
+                                      const struct ShardState *resume);
+FILE *shard_writer_file(struct ShardWriter *w, int shard);
+void shard_writer_count(struct ShardWriter *w, int shard);
+void shard_writer_flush(struct ShardWriter *w);
+void shard_writer_state(struct ShardWriter *w, struct ShardState *states);
+void shard_writer_fds(struct ShardWriter *w, int *fds);
+void shard_writer_close(struct ShardWriter *w, const char *description);
+
+#endif